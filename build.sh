@@ -3,7 +3,7 @@
 set -xe
 
 CFLAGS="-Wall -Werror -Wextra"
-FILES="src/main.c src/simulation.c src/visual.c"
+FILES="src/main.c src/simulation.c src/visual.c src/import.c src/parallel.c src/fault.c src/equiv.c src/bdd.c src/simthread.c src/journal.c src/coverage.c src/activity.c src/timing.c"
 RAYLIB="-I./raylib-5.5/include -L./raylib-5.5/lib/ -l:libraylib.a"
 
-gcc -o main $FILES $CFLAGS $RAYLIB -lm
+gcc -o main $FILES $CFLAGS $RAYLIB -lm -lpthread
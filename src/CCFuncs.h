@@ -6,6 +6,7 @@
 #include <assert.h>
 #include <stdarg.h>
 #include <string.h>
+#include <stddef.h>
 
 // DYNAMIC ARRAY //
 
@@ -61,7 +62,8 @@
     } while(0)
 
 // printf like function that prints the name and line of the file where it was called
-#define log_error(msg, ...) _log_error(msg, __FILE__, __LINE__, __VA_ARGS__);
+#define log_error(msg, ...) _log_error(msg, __FILE__, __LINE__, ##__VA_ARGS__);
+void _log_error(const char *msg, char *file, int line, ...);
 
 // STRING BUILDER //
 
@@ -93,8 +95,13 @@ typedef struct {
     size_t regionIndex;
 } Arena;
 
+#define ARENA_DEFAULT_ALIGNMENT _Alignof(max_align_t)
+
 Arena *arena_create(size_t regionSize);
 void *arena_alloc(Arena *arena, size_t size);
+// alignment must be a power of 2 not bigger than ARENA_DEFAULT_ALIGNMENT,
+// allocations bigger than the region size get a region of their own
+void *arena_alloc_aligned(Arena *arena, size_t size, size_t alignment);
 void arena_clear(Arena *arena); // clears the arena (NOTE: no region or allocation is freed)
 void arena_free(Arena *arena);
 
@@ -128,31 +135,49 @@ Arena *arena_create(size_t regionSize) {
 }
 
 void *arena_alloc(Arena *arena, size_t size) {
-    assert(size <= arena->regionSize && "Size cannot be bigger than region size");
+    return arena_alloc_aligned(arena, size, ARENA_DEFAULT_ALIGNMENT);
+}
+
+void *arena_alloc_aligned(Arena *arena, size_t size, size_t alignment) {
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0 && "Alignment must be a power of 2");
+    assert(alignment <= ARENA_DEFAULT_ALIGNMENT && "Alignment bigger than what malloc guarantees");
+
+    if(size > arena->regionSize) {
+        // the current region is kept, so its free space isn't wasted
+        void *data = malloc(size);
+        assert(data != NULL && "Not enough memory");
 
-    if(arena->count == 0) {
         da_append(arena, ((Region) {
-            .data = malloc(arena->regionSize),
-            .capacity = arena->regionSize,
+            .data = data,
+            .count = size,
+            .capacity = size,
         }));
+
+        return data;
     }
 
-    Region *region = &arena->items[arena->regionIndex];
+    // the regions before regionIndex are already full
+    for(; arena->regionIndex < arena->count; arena->regionIndex++) {
+        Region *region = &arena->items[arena->regionIndex];
+        size_t offset = (region->count + alignment - 1) & ~(alignment - 1);
 
-    if(region->count + size > region->capacity) {
-        if(arena->regionIndex >= arena->count - 1) {
-            da_append(arena, ((Region) {
-                .data = malloc(arena->regionSize),
-                .capacity = arena->regionSize,
-            }));
+        if(offset + size <= region->capacity) {
+            region->count = offset + size;
+            return (char*)region->data + offset;
         }
-
-        region = &arena->items[++arena->regionIndex];
     }
 
-    void *mem = region->data + region->count;
-    region->count += size;
-    return mem;
+    void *data = malloc(arena->regionSize);
+    assert(data != NULL && "Not enough memory");
+
+    da_append(arena, ((Region) {
+        .data = data,
+        .count = size,
+        .capacity = arena->regionSize,
+    }));
+    arena->regionIndex = arena->count - 1;
+
+    return data;
 }
 
 void arena_clear(Arena *arena) {
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "activity.h"
+#include "CCFuncs.h"
+
+// ActivityChip.level of every chip, by SimChip.index
+static uint32_t *ComputeLevels(void) {
+    size_t count = SimGetChipCount();
+    uint32_t *levels = malloc((count > 0 ? count : 1)*sizeof(uint32_t));
+    SimChip **order = malloc((count > 0 ? count : 1)*sizeof(SimChip*));
+    assert(levels != NULL && order != NULL && "No enough ram");
+
+    for(size_t i = 0; i < count; i++) levels[i] = ACTIVITY_NO_LEVEL;
+
+    // the drivers of a chip come before it
+    size_t sorted = SimSortTopologically(order);
+
+    for(size_t i = 0; i < sorted; i++) {
+        SimChip *chip = order[i];
+        uint32_t level = 0;
+
+        for(size_t j = 0; j < chip->inputs.count; j++) {
+            SimPin *pin = &chip->inputs.items[j];
+            if(pin->passive) continue;
+
+            if(pin->source != NULL) {
+                uint32_t sourceLevel = levels[pin->source->parentChip->index];
+                if(sourceLevel + 1 > level) level = sourceLevel + 1;
+            }
+
+            for(size_t k = 0; pin->net != NULL && k < pin->net->drivers.count; k++) {
+                uint32_t driverLevel = levels[pin->net->drivers.items[k]->parentChip->index];
+                if(driverLevel + 1 > level) level = driverLevel + 1;
+            }
+        }
+
+        levels[chip->index] = level;
+    }
+
+    free(order);
+    return levels;
+}
+
+static int CompareChipLoads(const void *a, const void *b) {
+    const ActivityChip *chipA = a, *chipB = b;
+
+    if(chipA->load != chipB->load) return chipA->load < chipB->load ? 1 : -1;
+    if(chipA->toggles != chipB->toggles) return chipA->toggles < chipB->toggles ? 1 : -1;
+    return (int)chipA->chip->index - (int)chipB->chip->index;
+}
+
+static ActivityLevel *GetLevel(ActivityReport *report, uint32_t level) {
+    while(report->levels.count <= level) {
+        ActivityLevel next = {report->levels.count, 0, 0, 0};
+        da_append(&report->levels, next);
+    }
+
+    return &report->levels.items[level];
+}
+
+void ActivityBuildReport(ActivityReport *report) {
+    assert(SimActivityIsEnabled() && "The activity isn't enabled");
+
+    *report = (ActivityReport){0};
+    uint32_t *levels = ComputeLevels();
+    ActivityLevel inLoops = {ACTIVITY_NO_LEVEL, 0, 0, 0};
+
+    for(size_t i = 0; i < SimGetChipCount(); i++) {
+        SimChip *chip = SimGetChip(i);
+        ActivityChip entry = {chip, levels[i], 0, 0};
+
+        for(size_t j = 0; j < chip->outputs.count; j++) {
+            SimPin *pin = &chip->outputs.items[j];
+            uint64_t toggles = SimActivityGetPin(pin);
+            size_t fanOut = SimGetFanOutCount(pin);
+
+            entry.toggles += toggles;
+            entry.load += toggles*fanOut;
+            report->outputBits += pin->width;
+        }
+
+        ActivityLevel *level = entry.level == ACTIVITY_NO_LEVEL ? &inLoops : GetLevel(report, entry.level);
+        level->chips++;
+        level->toggles += entry.toggles;
+        level->load += entry.load;
+
+        report->toggles += entry.toggles;
+        report->load += entry.load;
+
+        if(entry.toggles > 0) da_append(&report->chips, entry);
+    }
+
+    if(inLoops.chips > 0) da_append(&report->levels, inLoops);
+
+    if(report->chips.count > 0) {
+        qsort(report->chips.items, report->chips.count, sizeof(ActivityChip), CompareChipLoads);
+    }
+
+    free(levels);
+}
+
+static double GetShare(uint64_t load, uint64_t total) {
+    return total > 0 ? 100.0 * load / total : 0.0;
+}
+
+void ActivityPrintReport(ActivityReport *report, size_t vectorCount, size_t maxChips) {
+    double factor = report->outputBits > 0 && vectorCount > 0
+        ? (double)report->toggles / report->outputBits / vectorCount : 0.0;
+
+    printf("Switching activity: %lu transitions, activity factor %.4f per vector, switched load %lu\n",
+        report->toggles, factor, report->load);
+
+    printf("By level:\n");
+    for(size_t i = 0; i < report->levels.count; i++) {
+        ActivityLevel *level = &report->levels.items[i];
+
+        if(level->level == ACTIVITY_NO_LEVEL) {
+            printf("  in loops");
+        } else {
+            printf("  level %u", level->level);
+        }
+
+        printf(": %lu chips, %lu transitions, load %lu (%.2f%%)\n",
+            level->chips, level->toggles, level->load, GetShare(level->load, report->load));
+    }
+
+    if(report->chips.count == 0) return;
+
+    printf("Busiest chips:\n");
+    for(size_t i = 0; i < report->chips.count && i < maxChips; i++) {
+        ActivityChip *chip = &report->chips.items[i];
+
+        printf("  %s (#%u)", SimGetChipTypeName(chip->chip->type), chip->chip->id);
+        if(chip->level != ACTIVITY_NO_LEVEL) printf(" level %u", chip->level);
+
+        printf(": %lu transitions, load %lu (%.2f%%)\n",
+            chip->toggles, chip->load, GetShare(chip->load, report->load));
+    }
+
+    if(report->chips.count > maxChips) printf("  ... %lu more chips\n", report->chips.count - maxChips);
+}
+
+void ActivityReportFree(ActivityReport *report) {
+    da_free(&report->chips);
+    da_free(&report->levels);
+    *report = (ActivityReport){0};
+}
@@ -0,0 +1,57 @@
+#ifndef ACTIVITY_H
+#define ACTIVITY_H
+
+#include "simulation.h"
+
+// Switching activity report built from the counters of the simulation (see
+// SimActivityEnable). Every bit transition of an output pin is weighted by
+// its fan-out (the inputs it drives directly or through its net), which
+// stands for the capacitance being charged, so the "load" of a chip is
+// proportional to its dynamic power. The circuit is flat, so the chips are
+// grouped by their logic level (distance from the inputs) instead of by
+// module.
+
+typedef struct {
+    SimChip *chip;
+    uint32_t level;
+    uint64_t toggles;
+    uint64_t load;
+} ActivityChip;
+
+// chips in a loop (or driven by one) don't have a level
+#define ACTIVITY_NO_LEVEL UINT32_MAX
+
+typedef struct {
+    uint32_t level;
+    size_t chips;
+    uint64_t toggles;
+    uint64_t load;
+} ActivityLevel;
+
+typedef struct {
+    // the chips with some activity, the busiest first
+    struct {
+        ActivityChip *items;
+        size_t count;
+        size_t capacity;
+    } chips;
+
+    // by level, the chips without a level go last
+    struct {
+        ActivityLevel *items;
+        size_t count;
+        size_t capacity;
+    } levels;
+
+    size_t outputBits; // bits of all the output pins
+    uint64_t toggles;
+    uint64_t load;
+} ActivityReport;
+
+void ActivityBuildReport(ActivityReport *report);
+// The activity factor is the fraction of the output bits that switch per
+// vector. Prints up to "maxChips" chips.
+void ActivityPrintReport(ActivityReport *report, size_t vectorCount, size_t maxChips);
+void ActivityReportFree(ActivityReport *report);
+
+#endif // ACTIVITY_H
@@ -0,0 +1,549 @@
+#include <string.h>
+
+#include "bdd.h"
+#include "CCFuncs.h"
+
+#define BDD_INITIAL_NODES (1 << 12)
+#define BDD_CACHE_SIZE (1 << 18)
+// collect garbage when the nodes in use reach this, it's doubled when a
+// collection doesn't free at least half of them
+#define BDD_INITIAL_GC_THRESHOLD (1 << 16)
+#define BDD_NO_NODE UINT32_MAX
+// the variable of the terminals, it goes after every real variable
+#define BDD_TERMINAL_VAR UINT32_MAX
+#define BDD_FREE_VAR (UINT32_MAX - 1)
+
+typedef struct {
+    uint32_t var;
+    BddNode low; // the variable is 0
+    BddNode high; // the variable is 1
+    uint32_t next; // the next node of the unique table bucket or the free list
+    uint32_t refs;
+} BddNodeData;
+
+// result of ite(f, g, h)
+typedef struct {
+    BddNode f, g, h;
+    BddNode result;
+} BddCacheEntry;
+
+struct BddManager {
+    uint32_t varCount;
+
+    struct {
+        BddNodeData *items;
+        size_t count;
+        size_t capacity;
+    } nodes;
+
+    uint32_t freeList;
+    size_t usedCount; // nodes that aren't in the free list
+    size_t gcThreshold;
+
+    // unique table, one chain of nodes per bucket
+    uint32_t *buckets;
+    size_t bucketCount; // power of two
+
+    BddCacheEntry *cache;
+};
+
+static inline uint32_t HashTriple(uint32_t a, uint32_t b, uint32_t c) {
+    uint64_t h = (uint64_t)a*0x9E3779B97F4A7C15 ^ (uint64_t)b*0xC2B2AE3D27D4EB4F ^ (uint64_t)c*0x165667B19E3779F9;
+    return (h ^ (h >> 29)) >> 16;
+}
+
+static void ClearCache(BddManager *bdd) {
+    for(size_t i = 0; i < BDD_CACHE_SIZE; i++) {
+        bdd->cache[i].f = BDD_NO_NODE;
+    }
+}
+
+// rebuilds every chain, used when the table grows and after collecting garbage
+static void RehashNodes(BddManager *bdd, size_t bucketCount) {
+    if(bucketCount != bdd->bucketCount) {
+        free(bdd->buckets);
+        bdd->buckets = malloc(bucketCount*sizeof(uint32_t));
+        assert(bdd->buckets != NULL && "No enough ram");
+        bdd->bucketCount = bucketCount;
+    }
+
+    memset(bdd->buckets, 0xFF, bucketCount*sizeof(uint32_t));
+
+    // the terminals aren't in the table
+    for(size_t i = 2; i < bdd->nodes.count; i++) {
+        BddNodeData *node = &bdd->nodes.items[i];
+        if(node->var == BDD_FREE_VAR) continue;
+
+        uint32_t bucket = HashTriple(node->var, node->low, node->high) & (bucketCount - 1);
+        node->next = bdd->buckets[bucket];
+        bdd->buckets[bucket] = i;
+    }
+}
+
+BddManager *BddCreate(uint32_t varCount) {
+    assert(varCount < BDD_FREE_VAR && "Too many variables");
+
+    BddManager *bdd = calloc(1, sizeof(BddManager));
+    assert(bdd != NULL && "No enough ram");
+
+    bdd->varCount = varCount;
+    bdd->freeList = BDD_NO_NODE;
+    bdd->gcThreshold = BDD_INITIAL_GC_THRESHOLD;
+
+    da_init(&bdd->nodes, BDD_INITIAL_NODES);
+    da_append(&bdd->nodes, ((BddNodeData){BDD_TERMINAL_VAR, BDD_FALSE, BDD_FALSE, BDD_NO_NODE, 0}));
+    da_append(&bdd->nodes, ((BddNodeData){BDD_TERMINAL_VAR, BDD_TRUE, BDD_TRUE, BDD_NO_NODE, 0}));
+    bdd->usedCount = 2;
+
+    bdd->cache = malloc(BDD_CACHE_SIZE*sizeof(BddCacheEntry));
+    assert(bdd->cache != NULL && "No enough ram");
+    ClearCache(bdd);
+
+    RehashNodes(bdd, BDD_INITIAL_NODES);
+
+    return bdd;
+}
+
+void BddDestroy(BddManager *bdd) {
+    da_free(&bdd->nodes);
+    free(bdd->buckets);
+    free(bdd->cache);
+    free(bdd);
+}
+
+void BddRef(BddManager *bdd, BddNode node) {
+    bdd->nodes.items[node].refs++;
+}
+
+void BddDeref(BddManager *bdd, BddNode node) {
+    assert(bdd->nodes.items[node].refs > 0 && "The node isn't referenced");
+    bdd->nodes.items[node].refs--;
+}
+
+size_t BddGetNodeCount(BddManager *bdd) {
+    return bdd->usedCount;
+}
+
+static void MarkNode(BddManager *bdd, bool *marks, BddNode node) {
+    // the low side is walked in a loop, only the high side recurses
+    while(!marks[node]) {
+        marks[node] = true;
+        MarkNode(bdd, marks, bdd->nodes.items[node].high);
+        node = bdd->nodes.items[node].low;
+    }
+}
+
+void BddCollectGarbage(BddManager *bdd) {
+    bool *marks = calloc(bdd->nodes.count, sizeof(bool));
+    assert(marks != NULL && "No enough ram");
+
+    marks[BDD_FALSE] = true;
+    marks[BDD_TRUE] = true;
+
+    for(size_t i = 2; i < bdd->nodes.count; i++) {
+        BddNodeData *node = &bdd->nodes.items[i];
+        if(node->var != BDD_FREE_VAR && node->refs > 0) MarkNode(bdd, marks, i);
+    }
+
+    for(size_t i = 2; i < bdd->nodes.count; i++) {
+        BddNodeData *node = &bdd->nodes.items[i];
+        if(marks[i] || node->var == BDD_FREE_VAR) continue;
+
+        node->var = BDD_FREE_VAR;
+        node->next = bdd->freeList;
+        bdd->freeList = i;
+        bdd->usedCount--;
+    }
+
+    free(marks);
+
+    RehashNodes(bdd, bdd->bucketCount);
+    // the cache may have freed nodes
+    ClearCache(bdd);
+}
+
+// called before the operations that create nodes, "args" are kept alive
+static void MaybeCollectGarbage(BddManager *bdd, const BddNode *args, size_t argCount) {
+    if(bdd->usedCount < bdd->gcThreshold) return;
+
+    for(size_t i = 0; i < argCount; i++) BddRef(bdd, args[i]);
+
+    BddCollectGarbage(bdd);
+
+    for(size_t i = 0; i < argCount; i++) BddDeref(bdd, args[i]);
+
+    if(bdd->usedCount > bdd->gcThreshold/2) bdd->gcThreshold *= 2;
+}
+
+static BddNode MakeNode(BddManager *bdd, uint32_t var, BddNode low, BddNode high) {
+    if(low == high) return low;
+
+    uint32_t bucket = HashTriple(var, low, high) & (bdd->bucketCount - 1);
+
+    for(uint32_t i = bdd->buckets[bucket]; i != BDD_NO_NODE; i = bdd->nodes.items[i].next) {
+        BddNodeData *node = &bdd->nodes.items[i];
+        if(node->var == var && node->low == low && node->high == high) return i;
+    }
+
+    BddNodeData data = {var, low, high, bdd->buckets[bucket], 0};
+    BddNode node;
+
+    if(bdd->freeList != BDD_NO_NODE) {
+        node = bdd->freeList;
+        bdd->freeList = bdd->nodes.items[node].next;
+        bdd->nodes.items[node] = data;
+    } else {
+        assert(bdd->nodes.count < BDD_NO_NODE && "Too many nodes");
+        node = bdd->nodes.count;
+        da_append(&bdd->nodes, data);
+    }
+
+    bdd->buckets[bucket] = node;
+    bdd->usedCount++;
+
+    // keeps the chains short
+    if(bdd->usedCount > bdd->bucketCount) RehashNodes(bdd, bdd->bucketCount*2);
+
+    return node;
+}
+
+static inline uint32_t GetVar(BddManager *bdd, BddNode node) {
+    return bdd->nodes.items[node].var;
+}
+
+// the function with "var" set to "value", var must not be below the top of "node"
+static inline BddNode Cofactor(BddManager *bdd, BddNode node, uint32_t var, bool value) {
+    BddNodeData *data = &bdd->nodes.items[node];
+    if(data->var != var) return node;
+    return value ? data->high : data->low;
+}
+
+static BddNode Ite(BddManager *bdd, BddNode f, BddNode g, BddNode h) {
+    if(f == BDD_TRUE) return g;
+    if(f == BDD_FALSE) return h;
+    if(g == h) return g;
+    if(g == BDD_TRUE && h == BDD_FALSE) return f;
+
+    uint32_t slot = HashTriple(f, g, h) & (BDD_CACHE_SIZE - 1);
+    BddCacheEntry *entry = &bdd->cache[slot];
+    if(entry->f == f && entry->g == g && entry->h == h) return entry->result;
+
+    uint32_t var = GetVar(bdd, f);
+    if(GetVar(bdd, g) < var) var = GetVar(bdd, g);
+    if(GetVar(bdd, h) < var) var = GetVar(bdd, h);
+
+    BddNode low = Ite(bdd, Cofactor(bdd, f, var, 0), Cofactor(bdd, g, var, 0), Cofactor(bdd, h, var, 0));
+    BddNode high = Ite(bdd, Cofactor(bdd, f, var, 1), Cofactor(bdd, g, var, 1), Cofactor(bdd, h, var, 1));
+    BddNode result = MakeNode(bdd, var, low, high);
+
+    bdd->cache[slot] = (BddCacheEntry){f, g, h, result};
+
+    return result;
+}
+
+BddNode BddVar(BddManager *bdd, uint32_t var) {
+    assert(var < bdd->varCount);
+    MaybeCollectGarbage(bdd, NULL, 0);
+    return MakeNode(bdd, var, BDD_FALSE, BDD_TRUE);
+}
+
+BddNode BddIte(BddManager *bdd, BddNode f, BddNode g, BddNode h) {
+    BddNode args[] = {f, g, h};
+    MaybeCollectGarbage(bdd, args, 3);
+    return Ite(bdd, f, g, h);
+}
+
+BddNode BddNot(BddManager *bdd, BddNode f) {
+    return BddIte(bdd, f, BDD_FALSE, BDD_TRUE);
+}
+
+BddNode BddAnd(BddManager *bdd, BddNode f, BddNode g) {
+    return BddIte(bdd, f, g, BDD_FALSE);
+}
+
+BddNode BddOr(BddManager *bdd, BddNode f, BddNode g) {
+    return BddIte(bdd, f, BDD_TRUE, g);
+}
+
+BddNode BddXor(BddManager *bdd, BddNode f, BddNode g) {
+    BddNode args[] = {f, g};
+    MaybeCollectGarbage(bdd, args, 2);
+
+    BddNode notG = Ite(bdd, g, BDD_FALSE, BDD_TRUE);
+    return Ite(bdd, f, notG, g);
+}
+
+BddNode BddNand(BddManager *bdd, BddNode f, BddNode g) {
+    BddNode args[] = {f, g};
+    MaybeCollectGarbage(bdd, args, 2);
+
+    BddNode notG = Ite(bdd, g, BDD_FALSE, BDD_TRUE);
+    return Ite(bdd, f, notG, BDD_TRUE);
+}
+
+bool BddEval(BddManager *bdd, BddNode f, const uint8_t *assignment) {
+    while(f > BDD_TRUE) {
+        BddNodeData *node = &bdd->nodes.items[f];
+        f = assignment[node->var] ? node->high : node->low;
+    }
+
+    return f == BDD_TRUE;
+}
+
+// fraction of the assignments of the variables below the node where it's true
+static double SatFraction(BddManager *bdd, BddNode node, double *memo) {
+    if(node <= BDD_TRUE) return node;
+    if(memo[node] >= 0) return memo[node];
+
+    BddNodeData *data = &bdd->nodes.items[node];
+    double result = (SatFraction(bdd, data->low, memo) + SatFraction(bdd, data->high, memo)) / 2;
+
+    memo[node] = result;
+    return result;
+}
+
+double BddSatCount(BddManager *bdd, BddNode f) {
+    double *memo = malloc(bdd->nodes.count*sizeof(double));
+    assert(memo != NULL && "No enough ram");
+
+    for(size_t i = 0; i < bdd->nodes.count; i++) memo[i] = -1;
+
+    double count = SatFraction(bdd, f, memo);
+    for(uint32_t i = 0; i < bdd->varCount; i++) count *= 2;
+
+    free(memo);
+    return count;
+}
+
+bool BddFindSat(BddManager *bdd, BddNode f, uint8_t *assignment) {
+    if(f == BDD_FALSE) return false;
+
+    memset(assignment, 0, bdd->varCount);
+
+    // every node other than false leads to true
+    while(f != BDD_TRUE) {
+        BddNodeData *node = &bdd->nodes.items[f];
+
+        if(node->low != BDD_FALSE) {
+            f = node->low;
+        } else {
+            assignment[node->var] = 1;
+            f = node->high;
+        }
+    }
+
+    return true;
+}
+
+static size_t PrintCubes(BddManager *bdd, BddNode f, char *cube) {
+    if(f == BDD_FALSE) return 0;
+
+    if(f == BDD_TRUE) {
+        printf("%s\n", cube);
+        return 1;
+    }
+
+    BddNodeData node = bdd->nodes.items[f];
+
+    cube[node.var] = '0';
+    size_t count = PrintCubes(bdd, node.low, cube);
+    cube[node.var] = '1';
+    count += PrintCubes(bdd, node.high, cube);
+    cube[node.var] = '-';
+
+    return count;
+}
+
+size_t BddPrintCubes(BddManager *bdd, BddNode f) {
+    char *cube = malloc(bdd->varCount + 1);
+    assert(cube != NULL && "No enough ram");
+
+    memset(cube, '-', bdd->varCount);
+    cube[bdd->varCount] = '\0';
+
+    size_t count = PrintCubes(bdd, f, cube);
+
+    free(cube);
+    return count;
+}
+
+// the function seen by an input pin, the source chip must be already built
+static BddNode GetSourceNode(BddNode *slots, SimPin *input) {
+    return input->source != NULL ? slots[input->source->stateIndex] : BDD_FALSE;
+}
+
+static inline BddNode NotNode(BddManager *bdd, BddNode f) {
+    return Ite(bdd, f, BDD_FALSE, BDD_TRUE);
+}
+
+static inline BddNode XorNode(BddManager *bdd, BddNode f, BddNode g) {
+    return Ite(bdd, f, NotNode(bdd, g), g);
+}
+
+static bool CanBuildChip(SimChip *chip) {
+    switch(chip->type) {
+        case CHIP_NAND:
+        case CHIP_AND:
+        case CHIP_OR:
+        case CHIP_XOR:
+        case CHIP_NOT:
+        case CHIP_MUX:
+        case CHIP_FULL_ADDER:
+        case CHIP_LED:
+            break;
+        default:
+            return false;
+    }
+
+    // an input fed through a net doesn't have a source
+    for(size_t i = 0; i < chip->inputs.count; i++) {
+        if(chip->inputs.items[i].net != NULL || chip->inputs.items[i].width != 1) return false;
+    }
+
+    for(size_t i = 0; i < chip->outputs.count; i++) {
+        if(chip->outputs.items[i].net != NULL || chip->outputs.items[i].width != 1) return false;
+    }
+
+    return true;
+}
+
+// computes the functions of the outputs of the chip (of the input for the leds)
+static void BuildChip(BddManager *bdd, SimChip *chip, BddNode *slots, BddNode *outputs) {
+    BddNode in[3];
+    for(size_t i = 0; i < chip->inputs.count; i++) {
+        in[i] = GetSourceNode(slots, &chip->inputs.items[i]);
+    }
+
+    // the intermediate nodes aren't referenced, so there's a single chance
+    // of collecting garbage before they're created
+    MaybeCollectGarbage(bdd, in, chip->inputs.count);
+
+    switch(chip->type) {
+        case CHIP_NAND: outputs[0] = Ite(bdd, in[0], NotNode(bdd, in[1]), BDD_TRUE); break;
+        case CHIP_AND: outputs[0] = Ite(bdd, in[0], in[1], BDD_FALSE); break;
+        case CHIP_OR: outputs[0] = Ite(bdd, in[0], BDD_TRUE, in[1]); break;
+        case CHIP_XOR: outputs[0] = XorNode(bdd, in[0], in[1]); break;
+        case CHIP_NOT: outputs[0] = NotNode(bdd, in[0]); break;
+        case CHIP_MUX: outputs[0] = Ite(bdd, in[2], in[1], in[0]); break;
+        case CHIP_FULL_ADDER:
+            outputs[0] = XorNode(bdd, XorNode(bdd, in[0], in[1]), in[2]);
+            outputs[1] = Ite(bdd, in[0], Ite(bdd, in[1], BDD_TRUE, in[2]), Ite(bdd, in[1], in[2], BDD_FALSE));
+            break;
+        case CHIP_LED: outputs[0] = in[0]; break;
+        default: assert(false && "Unreachable");
+    }
+}
+
+bool BddBuildCircuit(BddManager *bdd, SimChip **inputs, size_t inputCount,
+                     SimChip **outputs, size_t outputCount, BddNode *results) {
+    assert(inputCount <= bdd->varCount);
+
+    size_t slotCount = SimGetStateSlotCount();
+    size_t chipCount = SimGetChipCount();
+    BddNode *slots = malloc((slotCount > 0 ? slotCount : 1)*sizeof(BddNode));
+    // indexed by SimChip.index: 0 = not visited, 1 = in the stack, 2 = built
+    uint8_t *visits = calloc(chipCount > 0 ? chipCount : 1, sizeof(uint8_t));
+    assert(slots != NULL && visits != NULL && "No enough ram");
+
+    for(size_t i = 0; i < inputCount; i++) {
+        assert(inputs[i]->type == CHIP_INPUT && "The inputs must be input chips");
+
+        uint32_t slot = inputs[i]->outputs.items[0].stateIndex;
+        slots[slot] = BddVar(bdd, i);
+        BddRef(bdd, slots[slot]);
+        visits[inputs[i]->index] = 2;
+    }
+
+    // the chips are visited in depth first order and built after their sources
+    struct {
+        SimChip **items;
+        size_t count;
+        size_t capacity;
+    } stack = {0};
+
+    struct {
+        BddNode *items;
+        size_t count;
+        size_t capacity;
+    } built = {0}; // referenced nodes, dereferenced at the end
+
+    bool ok = true;
+    size_t outputsBuilt = 0;
+
+    for(size_t i = 0; i < outputCount && ok; i++) {
+        assert(outputs[i]->type == CHIP_LED && "The outputs must be leds");
+        da_append(&stack, outputs[i]);
+
+        while(stack.count > 0 && ok) {
+            SimChip *chip = stack.items[stack.count - 1];
+
+            if(visits[chip->index] == 2) {
+                stack.count--;
+                continue;
+            }
+
+            if(!CanBuildChip(chip)) {
+                log_error("The chip %s (#%u) can't be converted to a BDD", SimGetChipTypeName(chip->type), chip->id);
+                ok = false;
+                break;
+            }
+
+            bool ready = true;
+            visits[chip->index] = 1;
+
+            for(size_t j = 0; j < chip->inputs.count; j++) {
+                SimPin *source = chip->inputs.items[j].source;
+                if(source == NULL || visits[source->parentChip->index] == 2) continue;
+
+                if(visits[source->parentChip->index] == 1) {
+                    log_error("The circuit has loops, it can't be converted to a BDD");
+                    ok = false;
+                    break;
+                }
+
+                da_append(&stack, source->parentChip);
+                ready = false;
+            }
+
+            if(!ok || !ready) continue;
+
+            BddNode nodes[2];
+            BuildChip(bdd, chip, slots, nodes);
+
+            // the leds don't have outputs, the slot of their input is used
+            SimPinArr pins = chip->type == CHIP_LED ? chip->inputs : chip->outputs;
+
+            for(size_t j = 0; j < pins.count; j++) {
+                slots[pins.items[j].stateIndex] = nodes[j];
+                BddRef(bdd, nodes[j]);
+                da_append(&built, nodes[j]);
+            }
+
+            visits[chip->index] = 2;
+            stack.count--;
+        }
+
+        if(ok) {
+            results[i] = slots[outputs[i]->inputs.items[0].stateIndex];
+            BddRef(bdd, results[i]);
+            outputsBuilt++;
+        }
+    }
+
+    if(!ok) {
+        for(size_t i = 0; i < outputsBuilt; i++) BddDeref(bdd, results[i]);
+    }
+
+    for(size_t i = 0; i < built.count; i++) BddDeref(bdd, built.items[i]);
+
+    for(size_t i = 0; i < inputCount; i++) {
+        BddDeref(bdd, slots[inputs[i]->outputs.items[0].stateIndex]);
+    }
+
+    da_free(&stack);
+    da_free(&built);
+    free(slots);
+    free(visits);
+
+    return ok;
+}
@@ -0,0 +1,58 @@
+#ifndef BDD_H
+#define BDD_H
+
+#include "simulation.h"
+
+// Reduced ordered binary decision diagrams. Every function has a single
+// node for a given variable order, so two functions are equal exactly when
+// their nodes are equal. Variable 0 is at the top of the order.
+//
+// Nodes that aren't referenced with BddRef may be freed by the garbage
+// collector at the start of any operation that creates nodes (its own
+// arguments are safe), so results that are kept must be referenced.
+
+typedef uint32_t BddNode;
+
+#define BDD_FALSE 0
+#define BDD_TRUE 1
+
+typedef struct BddManager BddManager;
+
+BddManager *BddCreate(uint32_t varCount);
+void BddDestroy(BddManager *bdd);
+
+void BddRef(BddManager *bdd, BddNode node);
+void BddDeref(BddManager *bdd, BddNode node);
+// frees the nodes that can't be reached from a referenced node
+void BddCollectGarbage(BddManager *bdd);
+size_t BddGetNodeCount(BddManager *bdd);
+
+BddNode BddVar(BddManager *bdd, uint32_t var);
+// if "f" then "g" else "h"
+BddNode BddIte(BddManager *bdd, BddNode f, BddNode g, BddNode h);
+BddNode BddNot(BddManager *bdd, BddNode f);
+BddNode BddAnd(BddManager *bdd, BddNode f, BddNode g);
+BddNode BddOr(BddManager *bdd, BddNode f, BddNode g);
+BddNode BddXor(BddManager *bdd, BddNode f, BddNode g);
+BddNode BddNand(BddManager *bdd, BddNode f, BddNode g);
+
+// "assignment" has one value (0 or 1) per variable
+bool BddEval(BddManager *bdd, BddNode f, const uint8_t *assignment);
+// number of assignments of every variable where "f" is true
+double BddSatCount(BddManager *bdd, BddNode f);
+// writes an assignment where "f" is true, the variables that don't matter
+// are 0. Returns false if "f" is always false.
+bool BddFindSat(BddManager *bdd, BddNode f, uint8_t *assignment);
+// Prints the truth table of "f" as disjoint cubes, one per line, with a
+// '0', '1' or '-' (don't care) per variable. Returns the number of cubes.
+size_t BddPrintCubes(BddManager *bdd, BddNode f);
+
+// Builds the function of every output of the circuit connected with
+// SimAddPinConnection, variable N is the chip inputs[N]. The results are
+// referenced. Only combinational circuits of single bit gates are
+// supported (no flip-flops, buses or nets), an unconnected input is off;
+// returns false and logs the error otherwise.
+bool BddBuildCircuit(BddManager *bdd, SimChip **inputs, size_t inputCount,
+                     SimChip **outputs, size_t outputCount, BddNode *results);
+
+#endif // BDD_H
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "coverage.h"
+#include "CCFuncs.h"
+
+#define COVERAGE_MAGIC "LSC1"
+// pins whose 2 bits go in a byte of the file
+#define COVERAGE_PINS_PER_BYTE 4
+
+static size_t GetPinCount(void) {
+    size_t count = 0;
+
+    for(size_t i = 0; i < SimGetChipCount(); i++) {
+        SimChip *chip = SimGetChip(i);
+        count += chip->inputs.count + chip->outputs.count;
+    }
+
+    return count;
+}
+
+// the inputs and then the outputs of the chip
+static SimPin *GetChipPin(SimChip *chip, size_t index) {
+    if(index < chip->inputs.count) return &chip->inputs.items[index];
+    return &chip->outputs.items[index - chip->inputs.count];
+}
+
+bool CoverageSave(const char *path) {
+    assert(SimCoverageIsEnabled() && "The coverage isn't enabled");
+
+    FILE *file = fopen(path, "wb");
+    if(file == NULL) {
+        log_error("Couldn't open \"%s\": %s", path, strerror(errno));
+        return false;
+    }
+
+    uint64_t header[2] = {SimGetChipCount(), GetPinCount()};
+    fwrite(COVERAGE_MAGIC, 1, strlen(COVERAGE_MAGIC), file);
+    fwrite(header, sizeof(uint64_t), 2, file);
+
+    uint8_t byte = 0;
+    size_t written = 0;
+
+    for(size_t i = 0; i < SimGetChipCount(); i++) {
+        SimChip *chip = SimGetChip(i);
+
+        for(size_t j = 0; j < chip->inputs.count + chip->outputs.count; j++) {
+            byte |= SimCoverageGetPin(GetChipPin(chip, j)) << (written % COVERAGE_PINS_PER_BYTE)*2;
+            written++;
+
+            if(written % COVERAGE_PINS_PER_BYTE == 0) {
+                fputc(byte, file);
+                byte = 0;
+            }
+        }
+    }
+
+    if(written % COVERAGE_PINS_PER_BYTE != 0) fputc(byte, file);
+
+    bool ok = !ferror(file);
+    if(fclose(file) != 0) ok = false;
+    if(!ok) log_error("Couldn't write \"%s\"", path);
+
+    return ok;
+}
+
+bool CoverageMerge(const char *path) {
+    assert(SimCoverageIsEnabled() && "The coverage isn't enabled");
+
+    FILE *file = fopen(path, "rb");
+    if(file == NULL) {
+        log_error("Couldn't open \"%s\": %s", path, strerror(errno));
+        return false;
+    }
+
+    char magic[sizeof(COVERAGE_MAGIC)] = {0};
+    uint64_t header[2];
+
+    if(fread(magic, 1, strlen(COVERAGE_MAGIC), file) != strlen(COVERAGE_MAGIC) || strcmp(magic, COVERAGE_MAGIC) != 0
+        || fread(header, sizeof(uint64_t), 2, file) != 2) {
+        log_error("\"%s\" isn't a coverage file", path);
+        fclose(file);
+        return false;
+    }
+
+    if(header[0] != SimGetChipCount() || header[1] != GetPinCount()) {
+        log_error("The coverage was collected on another circuit (%lu chips, the current one has %lu)",
+            header[0], SimGetChipCount());
+        fclose(file);
+        return false;
+    }
+
+    int byte = 0;
+    size_t read = 0;
+
+    for(size_t i = 0; i < SimGetChipCount() && byte != EOF; i++) {
+        SimChip *chip = SimGetChip(i);
+
+        for(size_t j = 0; j < chip->inputs.count + chip->outputs.count; j++) {
+            if(read % COVERAGE_PINS_PER_BYTE == 0) {
+                byte = fgetc(file);
+                if(byte == EOF) break;
+            }
+
+            uint8_t toggles = (byte >> (read % COVERAGE_PINS_PER_BYTE)*2) & 3;
+            SimCoverageMarkPin(GetChipPin(chip, j), toggles);
+            read++;
+        }
+    }
+
+    fclose(file);
+
+    if(byte == EOF) {
+        log_error("The coverage file \"%s\" is truncated", path);
+        return false;
+    }
+
+    return true;
+}
+
+void CoverageGetStats(CoverageStats *stats) {
+    *stats = (CoverageStats){0};
+
+    for(size_t i = 0; i < SimGetChipCount(); i++) {
+        SimChip *chip = SimGetChip(i);
+
+        for(size_t j = 0; j < chip->inputs.count + chip->outputs.count; j++) {
+            uint8_t toggles = SimCoverageGetPin(GetChipPin(chip, j));
+
+            stats->pins++;
+            if(toggles & SIM_TOGGLE_RISE) stats->rose++;
+            if(toggles & SIM_TOGGLE_FALL) stats->fell++;
+            if(toggles == (SIM_TOGGLE_RISE | SIM_TOGGLE_FALL)) stats->toggled++;
+        }
+    }
+}
+
+static const char *GetMissingEdges(uint8_t toggles) {
+    if(toggles & SIM_TOGGLE_RISE) return "never fell";
+    if(toggles & SIM_TOGGLE_FALL) return "never rose";
+    return "never toggled";
+}
+
+// returns false if every pin of the chip toggled
+static bool PrintChipCoverage(SimChip *chip) {
+    bool printed = false;
+
+    for(size_t j = 0; j < chip->inputs.count + chip->outputs.count; j++) {
+        SimPin *pin = GetChipPin(chip, j);
+        uint8_t toggles = SimCoverageGetPin(pin);
+        if(toggles == (SIM_TOGGLE_RISE | SIM_TOGGLE_FALL)) continue;
+
+        if(!printed) printf("  %s (#%u): ", SimGetChipTypeName(chip->type), chip->id);
+        else printf(", ");
+        printed = true;
+
+        size_t index = pin->isInput ? j : j - chip->inputs.count;
+        printf("%s %lu %s", pin->isInput ? "input" : "output", index, GetMissingEdges(toggles));
+    }
+
+    if(printed) printf("\n");
+    return printed;
+}
+
+void CoveragePrintReport(size_t maxChips) {
+    CoverageStats stats;
+    CoverageGetStats(&stats);
+
+    double coverage = stats.pins > 0 ? 100.0 * stats.toggled / stats.pins : 100.0;
+    printf("Toggle coverage: %.2f%% (%lu of %lu pins toggled, %lu rose, %lu fell)\n",
+        coverage, stats.toggled, stats.pins, stats.rose, stats.fell);
+
+    if(stats.toggled == stats.pins) return;
+
+    printf("Untoggled pins:\n");
+
+    size_t chips = 0, skipped = 0;
+    for(size_t i = 0; i < SimGetChipCount(); i++) {
+        SimChip *chip = SimGetChip(i);
+
+        if(chips < maxChips) {
+            if(PrintChipCoverage(chip)) chips++;
+            continue;
+        }
+
+        for(size_t j = 0; j < chip->inputs.count + chip->outputs.count; j++) {
+            if(SimCoverageGetPin(GetChipPin(chip, j)) != (SIM_TOGGLE_RISE | SIM_TOGGLE_FALL)) {
+                skipped++;
+                break;
+            }
+        }
+    }
+
+    if(skipped > 0) printf("  ... %lu more chips\n", skipped);
+}
@@ -0,0 +1,29 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include "simulation.h"
+
+// Saves, merges and reports the toggle coverage collected by the simulation
+// (see SimCoverageEnable). The file doesn't record the circuit: the pins are
+// saved in the order of the chips (SimChip.index) and merged into a circuit
+// built in the same way, so the runs of a regression can be added together.
+
+typedef struct {
+    size_t pins;
+    size_t rose;
+    size_t fell;
+    size_t toggled; // rose and fell
+} CoverageStats;
+
+// 2 bits per pin, returns false if the file can't be written
+bool CoverageSave(const char *path);
+// adds the toggles of a file to the current coverage, returns false and logs
+// the error if the file doesn't match the circuit
+bool CoverageMerge(const char *path);
+
+void CoverageGetStats(CoverageStats *stats);
+// prints the stats and the pins that didn't toggle, grouped by chip, for up
+// to "maxChips" chips
+void CoveragePrintReport(size_t maxChips);
+
+#endif // COVERAGE_H
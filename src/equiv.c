@@ -0,0 +1,183 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "equiv.h"
+#include "parallel.h"
+#include "CCFuncs.h"
+
+#define EQUIV_NO_MISMATCH UINT64_MAX
+
+typedef struct {
+    const ParallelNetlist *netlist;
+    EquivPort *inputs;
+    size_t inputCount;
+    EquivPort *outputs;
+    size_t outputCount;
+
+    uint64_t vectorCount;
+    uint64_t blockCount; // blocks of 64 vectors
+    uint64_t seed;
+
+    atomic_uint_fast64_t nextBlock;
+    atomic_uint_fast64_t mismatchBlock; // lowest block with a mismatch
+    atomic_uint_fast64_t checked;
+} EquivJob;
+
+static uint64_t SplitMix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    return z ^ (z >> 31);
+}
+
+// the lanes of the vectors of the block that are checked
+static uint64_t GetBlockMask(EquivJob *job, uint64_t block) {
+    uint64_t left = job->vectorCount - block*64;
+    return left >= 64 ? UINT64_MAX : ((uint64_t)1 << left) - 1;
+}
+
+// evaluates the block, returns the lanes where the outputs differ
+static uint64_t CheckBlock(EquivJob *job, ParallelSim *sim, uint64_t block) {
+    uint64_t rng = job->seed ^ (block * 0xD1B54A32D192ED03);
+
+    for(size_t i = 0; i < job->inputCount; i++) {
+        uint64_t lanes = SplitMix64(&rng);
+        ParallelSimSetInput(sim, job->inputs[i].a, lanes);
+        ParallelSimSetInput(sim, job->inputs[i].b, lanes);
+    }
+
+    ParallelSimEval(sim);
+
+    uint64_t diff = 0;
+    for(size_t i = 0; i < job->outputCount; i++) {
+        diff |= ParallelSimGetOutput(sim, job->outputs[i].a) ^ ParallelSimGetOutput(sim, job->outputs[i].b);
+    }
+
+    return diff & GetBlockMask(job, block);
+}
+
+static void *EquivWorker(void *arg) {
+    EquivJob *job = arg;
+
+    ParallelSim sim;
+    ParallelSimInit(&sim, job->netlist);
+
+    uint64_t checked = 0;
+
+    while(true) {
+        uint64_t block = atomic_fetch_add(&job->nextBlock, 1);
+        // the blocks after a mismatch aren't needed
+        if(block >= job->blockCount || block > atomic_load(&job->mismatchBlock)) break;
+
+        uint64_t diff = CheckBlock(job, &sim, block);
+        checked += __builtin_popcountll(GetBlockMask(job, block));
+
+        if(diff == 0) continue;
+
+        uint64_t current = atomic_load(&job->mismatchBlock);
+        while(block < current && !atomic_compare_exchange_weak(&job->mismatchBlock, &current, block));
+    }
+
+    atomic_fetch_add(&job->checked, checked);
+    ParallelSimFree(&sim);
+
+    return NULL;
+}
+
+static size_t GetThreadCount(uint64_t blockCount) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t count = cores > 0 ? cores : 1;
+    return blockCount < count ? blockCount : count;
+}
+
+// evaluates the mismatching block again to get the values of the first mismatching vector
+static void FillMismatch(EquivJob *job, uint64_t block, EquivResult *result) {
+    ParallelSim sim;
+    ParallelSimInit(&sim, job->netlist);
+
+    uint64_t diff = CheckBlock(job, &sim, block);
+    assert(diff != 0);
+
+    size_t lane = __builtin_ctzll(diff);
+
+    result->mismatch = true;
+    result->vector = block*64 + lane;
+    result->inputs = malloc((job->inputCount > 0 ? job->inputCount : 1)*sizeof(uint8_t));
+    result->outputsA = malloc((job->outputCount > 0 ? job->outputCount : 1)*sizeof(uint8_t));
+    result->outputsB = malloc((job->outputCount > 0 ? job->outputCount : 1)*sizeof(uint8_t));
+    assert(result->inputs != NULL && result->outputsA != NULL && result->outputsB != NULL && "No enough ram");
+
+    for(size_t i = 0; i < job->inputCount; i++) {
+        uint32_t slot = job->inputs[i].a->outputs.items[0].stateIndex;
+        result->inputs[i] = (sim.values[slot] >> lane) & 1;
+    }
+
+    for(size_t i = 0; i < job->outputCount; i++) {
+        result->outputsA[i] = (ParallelSimGetOutput(&sim, job->outputs[i].a) >> lane) & 1;
+        result->outputsB[i] = (ParallelSimGetOutput(&sim, job->outputs[i].b) >> lane) & 1;
+    }
+
+    ParallelSimFree(&sim);
+}
+
+bool EquivCheck(EquivPort *inputs, size_t inputCount, EquivPort *outputs, size_t outputCount,
+                uint64_t vectorCount, uint64_t seed, EquivResult *result) {
+    *result = (EquivResult){0};
+
+    for(size_t i = 0; i < inputCount; i++) {
+        assert(inputs[i].a->type == CHIP_INPUT && inputs[i].b->type == CHIP_INPUT && "The inputs must be input chips");
+    }
+
+    for(size_t i = 0; i < outputCount; i++) {
+        assert(outputs[i].a->type == CHIP_LED && outputs[i].b->type == CHIP_LED && "The outputs must be leds");
+    }
+
+    ParallelNetlist netlist;
+    if(!ParallelNetlistCompile(&netlist)) return false;
+
+    EquivJob job = {
+        .netlist = &netlist,
+        .inputs = inputs,
+        .inputCount = inputCount,
+        .outputs = outputs,
+        .outputCount = outputCount,
+        .vectorCount = vectorCount,
+        .blockCount = (vectorCount + 63) / 64,
+        .seed = seed,
+    };
+
+    atomic_init(&job.nextBlock, 0);
+    atomic_init(&job.mismatchBlock, EQUIV_NO_MISMATCH);
+    atomic_init(&job.checked, 0);
+
+    size_t threadCount = GetThreadCount(job.blockCount);
+    pthread_t *threads = malloc((threadCount > 0 ? threadCount : 1)*sizeof(pthread_t));
+    assert(threads != NULL && "No enough ram");
+
+    for(size_t i = 0; i < threadCount; i++) {
+        int err = pthread_create(&threads[i], NULL, EquivWorker, &job);
+        assert(err == 0 && "Couldn't create the thread");
+    }
+
+    for(size_t i = 0; i < threadCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    result->checked = atomic_load(&job.checked);
+
+    uint64_t mismatchBlock = atomic_load(&job.mismatchBlock);
+    if(mismatchBlock != EQUIV_NO_MISMATCH) FillMismatch(&job, mismatchBlock, result);
+
+    free(threads);
+    ParallelNetlistFree(&netlist);
+
+    return true;
+}
+
+void EquivResultFree(EquivResult *result) {
+    free(result->inputs);
+    free(result->outputsA);
+    free(result->outputsB);
+    *result = (EquivResult){0};
+}
@@ -0,0 +1,33 @@
+#ifndef EQUIV_H
+#define EQUIV_H
+
+#include "simulation.h"
+
+// a pair of chips, one per circuit
+typedef struct {
+    SimChip *a;
+    SimChip *b;
+} EquivPort;
+
+typedef struct {
+    bool mismatch;
+    uint64_t vector; // index of the first mismatching vector
+    uint64_t checked; // vectors simulated
+
+    // values of the first mismatching vector, one per port
+    uint8_t *inputs;
+    uint8_t *outputsA;
+    uint8_t *outputsB;
+} EquivResult;
+
+// Drives both circuits of the simulation with the same random vectors and
+// compares their outputs. The vectors are evaluated 64 at a time (see
+// parallel.h) on every core, each block of 64 vectors comes from its own
+// seed so the result doesn't depend on the number of threads. Stops at the
+// first mismatch or after "vectorCount" vectors. Only combinational single
+// bit circuits are supported; returns false and logs the error otherwise.
+bool EquivCheck(EquivPort *inputs, size_t inputCount, EquivPort *outputs, size_t outputCount,
+                uint64_t vectorCount, uint64_t seed, EquivResult *result);
+void EquivResultFree(EquivResult *result);
+
+#endif // EQUIV_H
@@ -0,0 +1,421 @@
+#include <string.h>
+#include <errno.h>
+
+#include "fault.h"
+#include "parallel.h"
+#include "CCFuncs.h"
+
+// lane 0 is the good machine
+#define FAULT_LANES 63
+
+bool FaultLoadVectors(const char *path, size_t inputCount, FaultVectors *vectors) {
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        log_error("Couldn't open \"%s\": %s", path, strerror(errno));
+        return false;
+    }
+
+    *vectors = (FaultVectors){0};
+
+    size_t line = 1;
+    size_t values = 0; // values read in the current line
+    bool comment = false;
+    bool ok = true;
+
+    for(int c = fgetc(file); ok; c = fgetc(file)) {
+        if(c == '\n' || c == EOF) {
+            if(values != 0 && values != inputCount) {
+                log_error("%s:%lu: expected %lu values, got %lu", path, line, inputCount, values);
+                ok = false;
+            }
+
+            if(c == EOF) break;
+
+            line++;
+            values = 0;
+            comment = false;
+        } else if(comment || c == ' ' || c == '\t' || c == '\r') {
+            continue;
+        } else if(c == '#') {
+            comment = true;
+        } else if(c == '0' || c == '1') {
+            da_append(vectors, c - '0');
+            values++;
+        } else {
+            log_error("%s:%lu: unexpected character '%c'", path, line, c);
+            ok = false;
+        }
+    }
+
+    fclose(file);
+
+    if(!ok) {
+        da_free(vectors);
+        *vectors = (FaultVectors){0};
+    }
+
+    return ok;
+}
+
+static void AddPinFaults(FaultReport *report, SimPinArr pins) {
+    for(size_t i = 0; i < pins.count; i++) {
+        da_append(&report->faults, ((Fault){&pins.items[i], FAULT_STUCK_AT_0, false}));
+        da_append(&report->faults, ((Fault){&pins.items[i], FAULT_STUCK_AT_1, false}));
+    }
+}
+
+// The good machine is simulated for blocks of 64 vectors, one vector per
+// lane. Then for each batch of faults and each vector only the chips whose
+// inputs differ from the good machine are evaluated, in topological order,
+// so a fault that is masked right away costs a single chip evaluation.
+typedef struct {
+    ParallelSim good;
+    const ParallelNetlist *netlist;
+
+    // lanes of the faulty machines, a slot is only valid when its stamp is
+    // the current one, otherwise it has the value of the good machine. The
+    // stamp moves once per batch and vector, 64 bits never wrap
+    uint64_t *faulty;
+    uint64_t *slotStamps;
+    uint64_t *chipStamps; // the chip was queued in the current stamp
+    uint64_t stamp;
+
+    // lanes forced to 0 or 1 on every pin by the faults of the batch
+    uint64_t *stuckAt0;
+    uint64_t *stuckAt1;
+
+    uint32_t *positions; // topological position of every chip, indexed by SimChip.index
+    bool *observed; // the chip is one of the outputs, indexed by SimChip.index
+    // an output can be reached from the chip, the faults of the other chips
+    // can't be detected so they aren't simulated
+    bool *observable;
+
+    // min-heap of the topological positions of the chips to evaluate
+    struct {
+        uint32_t *items;
+        size_t count;
+        size_t capacity;
+    } queue;
+} FaultSim;
+
+static void PushChip(FaultSim *fs, SimChip *chip) {
+    if(fs->chipStamps[chip->index] == fs->stamp || !fs->observable[chip->index]) return;
+    fs->chipStamps[chip->index] = fs->stamp;
+
+    da_append(&fs->queue, fs->positions[chip->index]);
+
+    uint32_t *heap = fs->queue.items;
+    size_t i = fs->queue.count - 1;
+
+    while(i > 0 && heap[(i - 1)/2] > heap[i]) {
+        uint32_t tmp = heap[i];
+        heap[i] = heap[(i - 1)/2];
+        heap[(i - 1)/2] = tmp;
+        i = (i - 1)/2;
+    }
+}
+
+static SimChip *PopChip(FaultSim *fs) {
+    uint32_t *heap = fs->queue.items;
+    uint32_t position = heap[0];
+    size_t count = --fs->queue.count;
+
+    heap[0] = heap[count];
+
+    size_t i = 0;
+    while(true) {
+        size_t min = i;
+        size_t left = 2*i + 1;
+        size_t right = left + 1;
+
+        if(left < count && heap[left] < heap[min]) min = left;
+        if(right < count && heap[right] < heap[min]) min = right;
+        if(min == i) break;
+
+        uint32_t tmp = heap[i];
+        heap[i] = heap[min];
+        heap[min] = tmp;
+        i = min;
+    }
+
+    return fs->netlist->order[position];
+}
+
+// walks back from the outputs
+static void FindObservableChips(FaultSim *fs, SimChip **outputs, size_t outputCount) {
+    struct {
+        SimChip **items;
+        size_t count;
+        size_t capacity;
+    } stack = {0};
+
+    for(size_t i = 0; i < outputCount; i++) {
+        if(fs->observable[outputs[i]->index]) continue;
+
+        fs->observable[outputs[i]->index] = true;
+        da_append(&stack, outputs[i]);
+    }
+
+    while(stack.count > 0) {
+        SimChip *chip = stack.items[--stack.count];
+
+        for(size_t i = 0; i < chip->inputs.count; i++) {
+            SimPin *source = chip->inputs.items[i].source;
+            if(source == NULL || fs->observable[source->parentChip->index]) continue;
+
+            fs->observable[source->parentChip->index] = true;
+            da_append(&stack, source->parentChip);
+        }
+    }
+
+    da_free(&stack);
+}
+
+static void SetFault(FaultSim *fs, Fault *fault, uint64_t lane) {
+    uint32_t slot = fault->pin->stateIndex;
+
+    if(fault->type == FAULT_STUCK_AT_0) {
+        fs->stuckAt0[slot] |= lane;
+    } else {
+        fs->stuckAt1[slot] |= lane;
+    }
+}
+
+static inline uint64_t GetGoodLanes(FaultSim *fs, uint32_t slot, size_t vector) {
+    return (fs->good.values[slot] >> vector) & 1 ? UINT64_MAX : 0;
+}
+
+static inline uint64_t ApplyFaults(FaultSim *fs, uint32_t slot, uint64_t lanes) {
+    return (lanes & ~fs->stuckAt0[slot]) | fs->stuckAt1[slot];
+}
+
+static uint64_t ReadFaultyInput(FaultSim *fs, SimPin *pin, size_t vector) {
+    SimPin *source = pin->source;
+    uint64_t lanes = 0; // an unconnected input is off
+
+    if(source != NULL) {
+        lanes = fs->slotStamps[source->stateIndex] == fs->stamp
+            ? fs->faulty[source->stateIndex]
+            : GetGoodLanes(fs, source->stateIndex, vector);
+    }
+
+    return ApplyFaults(fs, pin->stateIndex, lanes);
+}
+
+// evaluates the chip on every lane, the outputs that differ from the good
+// machine are stored and their targets queued. Returns the lanes where an
+// observed chip differs from the good machine.
+static uint64_t EvalFaultyChip(FaultSim *fs, SimChip *chip, size_t vector) {
+    uint64_t inputs[PARALLEL_MAX_PINS];
+    uint64_t outputs[PARALLEL_MAX_PINS];
+
+    for(size_t i = 0; i < chip->inputs.count; i++) {
+        inputs[i] = ReadFaultyInput(fs, &chip->inputs.items[i], vector);
+    }
+
+    if(fs->observed[chip->index]) {
+        // lane 0 is the good machine
+        return inputs[0] ^ ((inputs[0] & 1) ? UINT64_MAX : 0);
+    }
+
+    if(chip->type == CHIP_INPUT) {
+        outputs[0] = GetGoodLanes(fs, chip->outputs.items[0].stateIndex, vector);
+    } else {
+        ParallelEvalChip(chip, inputs, outputs);
+    }
+
+    for(size_t i = 0; i < chip->outputs.count; i++) {
+        SimPin *out = &chip->outputs.items[i];
+        uint64_t lanes = ApplyFaults(fs, out->stateIndex, outputs[i]);
+
+        if(lanes == GetGoodLanes(fs, out->stateIndex, vector)) continue;
+
+        fs->faulty[out->stateIndex] = lanes;
+        fs->slotStamps[out->stateIndex] = fs->stamp;
+
+        for(size_t j = 0; j < out->connectedTargets.count; j++) {
+            PushChip(fs, out->connectedTargets.items[j]->parentChip);
+        }
+    }
+
+    return 0;
+}
+
+// runs the vectors of the block until every fault of the batch is detected,
+// returns the detected lanes
+static uint64_t SimulateBatch(FaultSim *fs, Fault **batch, size_t batchCount, size_t blockSize, uint64_t batchLanes) {
+    uint64_t detected = 0;
+
+    for(size_t v = 0; v < blockSize && detected != batchLanes; v++) {
+        fs->stamp++;
+
+        for(size_t i = 0; i < batchCount; i++) {
+            PushChip(fs, batch[i]->pin->parentChip);
+        }
+
+        while(fs->queue.count > 0) {
+            detected |= EvalFaultyChip(fs, PopChip(fs), v);
+        }
+    }
+
+    return detected & batchLanes;
+}
+
+static void SimulateBlock(FaultSim *fs, FaultReport *report, size_t blockSize) {
+    Fault *batch[FAULT_LANES];
+    size_t next = 0;
+
+    while(next < report->faults.count) {
+        size_t batchCount = 0;
+        uint64_t batchLanes = 0;
+
+        while(batchCount < FAULT_LANES && next < report->faults.count) {
+            Fault *fault = &report->faults.items[next++];
+            if(fault->detected || !fs->observable[fault->pin->parentChip->index]) continue;
+
+            uint64_t lane = (uint64_t)1 << (batchCount + 1);
+
+            SetFault(fs, fault, lane);
+            batch[batchCount++] = fault;
+            batchLanes |= lane;
+        }
+
+        if(batchCount == 0) break;
+
+        uint64_t detected = SimulateBatch(fs, batch, batchCount, blockSize, batchLanes);
+
+        for(size_t i = 0; i < batchCount; i++) {
+            if(detected & ((uint64_t)1 << (i + 1))) {
+                batch[i]->detected = true;
+                report->detectedCount++;
+            }
+
+            fs->stuckAt0[batch[i]->pin->stateIndex] = 0;
+            fs->stuckAt1[batch[i]->pin->stateIndex] = 0;
+        }
+    }
+}
+
+bool FaultSimulate(SimChip **inputs, size_t inputCount, SimChip **outputs, size_t outputCount,
+                   const FaultVectors *vectors, FaultReport *report) {
+    *report = (FaultReport){0};
+
+    // the outputs are read with ParallelSimGetOutput
+    for(size_t i = 0; i < outputCount; i++) {
+        assert(outputs[i]->type == CHIP_LED && "The outputs must be leds");
+    }
+
+    ParallelNetlist netlist;
+    if(!ParallelNetlistCompile(&netlist)) return false;
+
+    size_t chipCount = SimGetChipCount();
+    for(size_t i = 0; i < chipCount; i++) {
+        SimChip *chip = SimGetChip(i);
+        AddPinFaults(report, chip->inputs);
+        AddPinFaults(report, chip->outputs);
+    }
+
+    report->vectorCount = inputCount > 0 ? vectors->count / inputCount : 0;
+
+    size_t chips = chipCount > 0 ? chipCount : 1;
+    size_t slots = netlist.slotCount > 0 ? netlist.slotCount : 1;
+
+    FaultSim fs = {0};
+    ParallelSimInit(&fs.good, &netlist);
+    fs.netlist = &netlist;
+    fs.faulty = malloc(slots*sizeof(uint64_t));
+    fs.slotStamps = calloc(slots, sizeof(uint64_t));
+    fs.chipStamps = calloc(chips, sizeof(uint64_t));
+    fs.stuckAt0 = calloc(slots, sizeof(uint64_t));
+    fs.stuckAt1 = calloc(slots, sizeof(uint64_t));
+    fs.positions = malloc(chips*sizeof(uint32_t));
+    fs.observed = calloc(chips, sizeof(bool));
+    fs.observable = calloc(chips, sizeof(bool));
+    assert(fs.faulty != NULL && fs.slotStamps != NULL && fs.chipStamps != NULL && "No enough ram");
+    assert(fs.stuckAt0 != NULL && fs.stuckAt1 != NULL && fs.positions != NULL && "No enough ram");
+    assert(fs.observed != NULL && fs.observable != NULL && "No enough ram");
+
+    for(size_t i = 0; i < outputCount; i++) {
+        fs.observed[outputs[i]->index] = true;
+    }
+
+    FindObservableChips(&fs, outputs, outputCount);
+
+    for(size_t i = 0; i < netlist.count; i++) {
+        fs.positions[netlist.order[i]->index] = i;
+    }
+
+    for(size_t block = 0; block < report->vectorCount; block += 64) {
+        size_t blockSize = report->vectorCount - block;
+        if(blockSize > 64) blockSize = 64;
+
+        // lane N of the good machine gets the vector "block + N"
+        for(size_t i = 0; i < inputCount; i++) {
+            uint64_t lanes = 0;
+
+            for(size_t v = 0; v < blockSize; v++) {
+                lanes |= (uint64_t)vectors->items[(block + v)*inputCount + i] << v;
+            }
+
+            ParallelSimSetInput(&fs.good, inputs[i], lanes);
+        }
+
+        ParallelSimEval(&fs.good);
+        SimulateBlock(&fs, report, blockSize);
+
+        if(report->detectedCount == report->faults.count) break;
+    }
+
+    ParallelSimFree(&fs.good);
+    free(fs.faulty);
+    free(fs.slotStamps);
+    free(fs.chipStamps);
+    free(fs.stuckAt0);
+    free(fs.stuckAt1);
+    free(fs.positions);
+    free(fs.observed);
+    free(fs.observable);
+    da_free(&fs.queue);
+    ParallelNetlistFree(&netlist);
+
+    return true;
+}
+
+static void PrintFault(Fault *fault) {
+    SimPin *pin = fault->pin;
+    SimChip *chip = pin->parentChip;
+    SimPinArr pins = pin->isInput ? chip->inputs : chip->outputs;
+
+    printf("  %s (#%u) %s %lu stuck-at-%d\n",
+        SimGetChipTypeName(chip->type), chip->id,
+        pin->isInput ? "input" : "output", (size_t)(pin - pins.items),
+        fault->type == FAULT_STUCK_AT_0 ? 0 : 1);
+}
+
+void FaultPrintReport(FaultReport *report, size_t maxUndetected) {
+    size_t total = report->faults.count;
+    double coverage = total > 0 ? 100.0 * report->detectedCount / total : 100.0;
+
+    printf("Fault coverage: %.2f%% (%lu of %lu faults detected with %lu vectors)\n",
+        coverage, report->detectedCount, total, report->vectorCount);
+
+    size_t undetected = total - report->detectedCount;
+    if(undetected == 0) return;
+
+    printf("Undetected faults:\n");
+
+    size_t printed = 0;
+    for(size_t i = 0; i < total && printed < maxUndetected; i++) {
+        if(!report->faults.items[i].detected) {
+            PrintFault(&report->faults.items[i]);
+            printed++;
+        }
+    }
+
+    if(printed < undetected) printf("  ... %lu more\n", undetected - printed);
+}
+
+void FaultReportFree(FaultReport *report) {
+    da_free(&report->faults);
+    *report = (FaultReport){0};
+}
@@ -0,0 +1,51 @@
+#ifndef FAULT_H
+#define FAULT_H
+
+#include "simulation.h"
+
+typedef enum {
+    FAULT_STUCK_AT_0,
+    FAULT_STUCK_AT_1,
+} FaultType;
+
+typedef struct {
+    SimPin *pin;
+    FaultType type;
+    bool detected;
+} Fault;
+
+typedef struct {
+    struct {
+        Fault *items;
+        size_t count;
+        size_t capacity;
+    } faults;
+
+    size_t detectedCount;
+    size_t vectorCount;
+} FaultReport;
+
+// test vectors, one value per primary input and vector
+typedef struct {
+    uint8_t *items;
+    size_t count;
+    size_t capacity;
+} FaultVectors;
+
+// Reads one vector per line, a '0' or '1' per input in the order of the
+// inputs. Spaces are ignored and '#' starts a comment.
+bool FaultLoadVectors(const char *path, size_t inputCount, FaultVectors *vectors);
+
+// Grades the test vectors against every single stuck-at-0/1 fault on every
+// pin of the simulation. Faults are simulated in batches of 63 faulty
+// machines plus the good one in lane 0 (see parallel.h), a fault is detected
+// when an output differs from the good machine. Detected faults are dropped
+// from the next batches. Only combinational single bit circuits are supported.
+bool FaultSimulate(SimChip **inputs, size_t inputCount, SimChip **outputs, size_t outputCount,
+                   const FaultVectors *vectors, FaultReport *report);
+
+// prints the coverage and up to "maxUndetected" undetected faults
+void FaultPrintReport(FaultReport *report, size_t maxUndetected);
+void FaultReportFree(FaultReport *report);
+
+#endif // FAULT_H
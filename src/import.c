@@ -0,0 +1,1448 @@
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "import.h"
+#include "CCFuncs.h"
+
+// the file is read in chunks of this size, so the memory used by the parser
+// doesn't depend on the size of the file
+#define IMPORT_CHUNK_SIZE (64*1024)
+#define IMPORT_MAX_TOKEN 1024
+#define IMPORT_NAMES_REGION_SIZE (64*1024)
+#define IMPORT_TABLE_INIT_CAP 1024
+#define IMPORT_NO_NET UINT32_MAX
+// covers with this many inputs or less are matched against the primitives
+#define IMPORT_MATCH_INPUTS 3
+// the full adders searched when a sum or a carry is emitted
+#define IMPORT_ADDER_LOOKBACK 16
+
+static bool nandOnly = false;
+
+void ImportSetNandOnly(bool enabled) {
+    nandOnly = enabled;
+}
+
+typedef struct {
+    FILE *file;
+    char buf[IMPORT_CHUNK_SIZE];
+    size_t pos;
+    size_t len;
+    size_t line;
+} ImportReader;
+
+typedef struct {
+    char *name; // NULL for the nets created by the importer
+    SimPin *driver;
+    uint32_t alias; // net connected to this one through a buffer or an assign
+    uint32_t inverted; // cached NOT of this net
+} ImportNet;
+
+// input pin waiting for its net to be resolved, the driver of a net can be
+// declared after its first use so pins are only connected at the end
+typedef struct {
+    uint32_t net;
+    SimPin *pin;
+} ImportSink;
+
+typedef struct {
+    uint32_t *items;
+    size_t count;
+    size_t capacity;
+} ImportNetList;
+
+typedef struct {
+    uint32_t inputs[3]; // sorted
+    uint32_t sum;
+    uint32_t carry;
+} ImportAdder;
+
+typedef enum {
+    GATE_AND,
+    GATE_NAND,
+    GATE_OR,
+    GATE_NOR,
+    GATE_XOR,
+    GATE_XNOR,
+    GATE_BUF,
+    GATE_NOT,
+} ImportGate;
+
+typedef enum {
+    DECL_NONE,
+    DECL_INPUT,
+    DECL_OUTPUT,
+    DECL_WIRE,
+} ImportDecl;
+
+typedef enum {
+    TOKEN_END,
+    TOKEN_NAME,
+    TOKEN_NUMBER,
+    TOKEN_PUNCT,
+} ImportTokenType;
+
+typedef struct {
+    const char *path;
+    size_t line; // line of the statement being parsed
+    ImportReader *reader;
+    ImportResult *result;
+
+    struct {
+        ImportNet *items;
+        size_t count;
+        size_t capacity;
+    } nets;
+
+    // open addressing hash table of the named nets, every slot holds
+    // the index of a net or IMPORT_NO_NET
+    struct {
+        uint32_t *items;
+        size_t count;
+        size_t capacity;
+    } table;
+    Arena *names;
+
+    struct {
+        ImportSink *items;
+        size_t count;
+        size_t capacity;
+    } sinks;
+
+    uint32_t const1;
+    bool nandOnly;
+
+    // full adders already emitted, so the sum and the carry of the same
+    // inputs share one chip
+    struct {
+        ImportAdder *items;
+        size_t count;
+        size_t capacity;
+    } adders;
+
+    // scratch arrays reused between statements
+    ImportNetList terms;
+    ImportNetList cubes;
+
+    // BLIF
+    StringBuilder lineBuf;
+    struct {
+        char **items;
+        size_t count;
+        size_t capacity;
+    } tokens;
+    ImportNetList namesInputs;
+    uint32_t namesOutput;
+    int namesPhase;
+    // rows of the covers with up to IMPORT_MATCH_INPUTS inputs, they're
+    // emitted at the end in case the cover is a single primitive. Each row
+    // is stored as "care << 8 | value", a bit per input
+    ImportNetList namesRows;
+
+    // Verilog
+    ImportTokenType tokenType;
+    char token[IMPORT_MAX_TOKEN];
+} Importer;
+
+static void ReportError(Importer *imp, const char *msg, ...) {
+    printf("[ERROR]: %s:%lu: ", imp->path, imp->line);
+
+    va_list args;
+    va_start(args, msg);
+    vprintf(msg, args);
+    va_end(args);
+
+    printf("\n");
+}
+
+static const char *GetNetName(Importer *imp, uint32_t net) {
+    const char *name = imp->nets.items[net].name;
+    return name != NULL ? name : "<internal>";
+}
+
+// READER //
+
+static bool FillReader(ImportReader *reader) {
+    if(reader->pos < reader->len) return true;
+
+    reader->len = fread(reader->buf, 1, IMPORT_CHUNK_SIZE, reader->file);
+    reader->pos = 0;
+
+    return reader->len > 0;
+}
+
+static int PeekChar(ImportReader *reader) {
+    if(!FillReader(reader)) return EOF;
+    return (unsigned char)reader->buf[reader->pos];
+}
+
+static int ReadChar(ImportReader *reader) {
+    if(!FillReader(reader)) return EOF;
+
+    int c = (unsigned char)reader->buf[reader->pos++];
+    if(c == '\n') reader->line++;
+
+    return c;
+}
+
+// NETS //
+
+static uint32_t CreateNet(Importer *imp, char *name) {
+    ImportNet net = {
+        .name = name,
+        .alias = IMPORT_NO_NET,
+        .inverted = IMPORT_NO_NET,
+    };
+    da_append(&imp->nets, net);
+
+    assert(imp->nets.count < IMPORT_NO_NET && "Too many nets");
+    return imp->nets.count - 1;
+}
+
+static uint32_t HashName(const char *name, size_t len) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+
+    for(size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static void GrowTable(Importer *imp) {
+    size_t capacity = imp->table.capacity == 0 ? IMPORT_TABLE_INIT_CAP : imp->table.capacity*2;
+    uint32_t *items = malloc(capacity*sizeof(uint32_t));
+    assert(items != NULL && "No enough ram");
+    memset(items, 0xff, capacity*sizeof(uint32_t));
+
+    for(size_t i = 0; i < imp->table.capacity; i++) {
+        uint32_t net = imp->table.items[i];
+        if(net == IMPORT_NO_NET) continue;
+
+        const char *name = imp->nets.items[net].name;
+        size_t slot = HashName(name, strlen(name)) & (capacity - 1);
+        while(items[slot] != IMPORT_NO_NET) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        items[slot] = net;
+    }
+
+    free(imp->table.items);
+    imp->table.items = items;
+    imp->table.capacity = capacity;
+}
+
+// returns the net with that name, creating it the first time the name is seen
+static uint32_t InternNet(Importer *imp, const char *name, size_t len) {
+    // keep the load factor under 70%
+    if((imp->table.count + 1)*10 > imp->table.capacity*7) {
+        GrowTable(imp);
+    }
+
+    size_t mask = imp->table.capacity - 1;
+    size_t slot = HashName(name, len) & mask;
+
+    while(imp->table.items[slot] != IMPORT_NO_NET) {
+        uint32_t net = imp->table.items[slot];
+        const char *netName = imp->nets.items[net].name;
+
+        if(strncmp(netName, name, len) == 0 && netName[len] == '\0') {
+            return net;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    char *copy = arena_alloc_aligned(imp->names, len + 1, 1);
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+
+    uint32_t net = CreateNet(imp, copy);
+    imp->table.items[slot] = net;
+    imp->table.count++;
+
+    return net;
+}
+
+static void ConnectSink(Importer *imp, uint32_t net, SimPin *pin) {
+    ImportSink sink = {
+        .net = net,
+        .pin = pin,
+    };
+    da_append(&imp->sinks, sink);
+}
+
+static bool DriveNet(Importer *imp, uint32_t dst, uint32_t src) {
+    ImportNet *net = &imp->nets.items[dst];
+
+    if(net->driver != NULL || net->alias != IMPORT_NO_NET) {
+        ReportError(imp, "Net \"%s\" has more than one driver", GetNetName(imp, dst));
+        return false;
+    }
+
+    net->alias = src;
+    return true;
+}
+
+static bool DeclareInput(Importer *imp, uint32_t net) {
+    if(imp->nets.items[net].driver != NULL || imp->nets.items[net].alias != IMPORT_NO_NET) {
+        ReportError(imp, "Input \"%s\" is already driven", GetNetName(imp, net));
+        return false;
+    }
+
+    SimChip *input = SimInputCreate();
+    imp->nets.items[net].driver = SimGetOutputPin(input, 0);
+    imp->result->chipCount++;
+
+    ImportPort port = {
+        .name = strdup(GetNetName(imp, net)),
+        .chip = input,
+    };
+    da_append(&imp->result->inputs, port);
+
+    return true;
+}
+
+static void DeclareOutput(Importer *imp, uint32_t net) {
+    SimChip *led = SimLedCreate();
+    ConnectSink(imp, net, SimGetInputPin(led, 0));
+    imp->result->chipCount++;
+
+    ImportPort port = {
+        .name = strdup(GetNetName(imp, net)),
+        .chip = led,
+    };
+    da_append(&imp->result->outputs, port);
+}
+
+// follows the aliases of the net until a driver is found, returns NULL when
+// the net is undriven or part of a loop of buffers
+static SimPin *ResolveDriver(Importer *imp, uint32_t net) {
+    uint32_t root = net;
+    size_t hops = 0;
+
+    while(imp->nets.items[root].alias != IMPORT_NO_NET) {
+        root = imp->nets.items[root].alias;
+        if(++hops > imp->nets.count) return NULL;
+    }
+
+    // point every alias of the chain directly to the root, so the next
+    // pins connected to these nets don't walk the chain again
+    while(net != root) {
+        uint32_t next = imp->nets.items[net].alias;
+        imp->nets.items[net].alias = root;
+        net = next;
+    }
+
+    return imp->nets.items[root].driver;
+}
+
+// GATES //
+
+// The gates are built with the single bit primitives of the simulation, or
+// only with 2 input NANDs when "nandOnly" is set
+
+// connects the inputs and creates a net for every output, returns the first one
+static uint32_t EmitChip(Importer *imp, SimChip *chip, const uint32_t *inputs, uint32_t *outputs) {
+    for(size_t i = 0; i < chip->inputs.count; i++) {
+        ConnectSink(imp, inputs[i], SimGetInputPin(chip, i));
+    }
+
+    imp->result->chipCount++;
+
+    uint32_t first = IMPORT_NO_NET;
+    for(size_t i = 0; i < chip->outputs.count; i++) {
+        uint32_t out = CreateNet(imp, NULL);
+        imp->nets.items[out].driver = SimGetOutputPin(chip, i);
+
+        if(outputs != NULL) outputs[i] = out;
+        if(i == 0) first = out;
+    }
+
+    return first;
+}
+
+static uint32_t EmitNand(Importer *imp, uint32_t a, uint32_t b) {
+    uint32_t inputs[] = {a, b};
+    return EmitChip(imp, SimNandCreate(), inputs, NULL);
+}
+
+static uint32_t EmitNot(Importer *imp, uint32_t a) {
+    if(imp->nets.items[a].inverted != IMPORT_NO_NET) {
+        return imp->nets.items[a].inverted;
+    }
+
+    uint32_t out = imp->nandOnly ? EmitNand(imp, a, a) : EmitChip(imp, SimNotCreate(), &a, NULL);
+
+    // the cache goes both ways, so NOT(NOT(a)) is "a" again without any gate
+    imp->nets.items[a].inverted = out;
+    imp->nets.items[out].inverted = a;
+
+    return out;
+}
+
+static uint32_t GetConst1(Importer *imp) {
+    if(imp->const1 == IMPORT_NO_NET) {
+        // a NAND with its inputs unconnected is always on
+        SimChip *nand = SimNandCreate();
+        imp->result->chipCount++;
+
+        imp->const1 = CreateNet(imp, NULL);
+        imp->nets.items[imp->const1].driver = SimGetOutputPin(nand, 0);
+    }
+
+    return imp->const1;
+}
+
+static uint32_t GetConst0(Importer *imp) {
+    return EmitNot(imp, GetConst1(imp));
+}
+
+static uint32_t EmitAnd(Importer *imp, uint32_t a, uint32_t b) {
+    if(imp->nandOnly) return EmitNot(imp, EmitNand(imp, a, b));
+
+    uint32_t inputs[] = {a, b};
+    return EmitChip(imp, SimAndCreate(), inputs, NULL);
+}
+
+static uint32_t EmitOr(Importer *imp, uint32_t a, uint32_t b) {
+    // OR(a, b) = NAND(NOT a, NOT b)
+    if(imp->nandOnly) return EmitNand(imp, EmitNot(imp, a), EmitNot(imp, b));
+
+    uint32_t inputs[] = {a, b};
+    return EmitChip(imp, SimOrCreate(), inputs, NULL);
+}
+
+static uint32_t EmitXor(Importer *imp, uint32_t a, uint32_t b) {
+    if(imp->nandOnly) {
+        uint32_t nand = EmitNand(imp, a, b);
+        return EmitNand(imp, EmitNand(imp, a, nand), EmitNand(imp, b, nand));
+    }
+
+    uint32_t inputs[] = {a, b};
+    return EmitChip(imp, SimXorCreate(), inputs, NULL);
+}
+
+// the output is "b" when "select" is on
+static uint32_t EmitMux(Importer *imp, uint32_t a, uint32_t b, uint32_t select) {
+    if(imp->nandOnly) {
+        return EmitNand(imp, EmitNand(imp, a, EmitNot(imp, select)), EmitNand(imp, b, select));
+    }
+
+    uint32_t inputs[] = {a, b, select};
+    return EmitChip(imp, SimMuxCreate(), inputs, NULL);
+}
+
+static int CompareNets(const void *a, const void *b) {
+    uint32_t netA = *(const uint32_t*)a;
+    uint32_t netB = *(const uint32_t*)b;
+    return (netA > netB) - (netA < netB);
+}
+
+// returns the sum or the carry of a full adder, the adder of the same
+// inputs is reused if it was emitted recently
+static uint32_t EmitAdder(Importer *imp, const uint32_t *inputs, bool carry) {
+    if(imp->nandOnly) {
+        uint32_t halfSum = EmitXor(imp, inputs[0], inputs[1]);
+        if(!carry) return EmitXor(imp, halfSum, inputs[2]);
+
+        return EmitOr(imp, EmitAnd(imp, inputs[0], inputs[1]), EmitAnd(imp, halfSum, inputs[2]));
+    }
+
+    ImportAdder adder = {0};
+    memcpy(adder.inputs, inputs, sizeof(adder.inputs));
+    qsort(adder.inputs, 3, sizeof(uint32_t), CompareNets);
+
+    size_t first = imp->adders.count > IMPORT_ADDER_LOOKBACK ? imp->adders.count - IMPORT_ADDER_LOOKBACK : 0;
+    for(size_t i = imp->adders.count; i > first; i--) {
+        ImportAdder *prev = &imp->adders.items[i - 1];
+
+        if(memcmp(prev->inputs, adder.inputs, sizeof(adder.inputs)) == 0) {
+            return carry ? prev->carry : prev->sum;
+        }
+    }
+
+    uint32_t outputs[2];
+    EmitChip(imp, SimFullAdderCreate(), adder.inputs, outputs);
+
+    adder.sum = outputs[0];
+    adder.carry = outputs[1];
+    da_append(&imp->adders, adder);
+
+    return carry ? adder.carry : adder.sum;
+}
+
+// the data is taken on the rising edge of the clock. The flip-flops are
+// native even with NANDs only, a NAND flip-flop doesn't power up in a known
+// state with unit delays
+static uint32_t EmitDff(Importer *imp, uint32_t data, uint32_t clock, bool initialValue) {
+    SimChip *dff = SimDffCreate();
+    if(initialValue) SimSetOutputPinState(dff, 0, SIM_PIN_ON);
+
+    uint32_t inputs[] = {data, clock};
+    return EmitChip(imp, dff, inputs, NULL);
+}
+
+// transparent while the enable is on, native like the flip-flops
+static uint32_t EmitLatch(Importer *imp, uint32_t data, uint32_t enable, bool initialValue) {
+    SimChip *latch = SimLatchCreate();
+    if(initialValue) SimSetOutputPinState(latch, 0, SIM_PIN_ON);
+
+    uint32_t inputs[] = {data, enable};
+    return EmitChip(imp, latch, inputs, NULL);
+}
+
+// AND of the nets using a balanced tree of gates
+static uint32_t EmitAndTree(Importer *imp, const uint32_t *nets, size_t count) {
+    if(count == 0) return GetConst1(imp);
+    if(count == 1) return nets[0];
+
+    size_t half = count / 2;
+    uint32_t left = EmitAndTree(imp, nets, half);
+    uint32_t right = EmitAndTree(imp, nets + half, count - half);
+
+    return EmitAnd(imp, left, right);
+}
+
+static uint32_t EmitNandTree(Importer *imp, const uint32_t *nets, size_t count) {
+    if(count == 0) return GetConst0(imp);
+    if(count == 1) return EmitNot(imp, nets[0]);
+
+    size_t half = count / 2;
+    uint32_t left = EmitAndTree(imp, nets, half);
+    uint32_t right = EmitAndTree(imp, nets + half, count - half);
+
+    return EmitNand(imp, left, right);
+}
+
+static uint32_t EmitOrTree(Importer *imp, const uint32_t *nets, size_t count) {
+    if(count == 0) return GetConst0(imp);
+    if(count == 1) return nets[0];
+
+    size_t half = count / 2;
+    uint32_t left = EmitOrTree(imp, nets, half);
+    uint32_t right = EmitOrTree(imp, nets + half, count - half);
+
+    return EmitOr(imp, left, right);
+}
+
+// NOTE: the inputs array is used as scratch space
+static uint32_t EmitGate(Importer *imp, ImportGate gate, uint32_t *inputs, size_t count) {
+    assert(count > 0);
+
+    switch(gate) {
+        case GATE_AND: return EmitAndTree(imp, inputs, count);
+        case GATE_NAND: return EmitNandTree(imp, inputs, count);
+        case GATE_OR:
+        case GATE_NOR: {
+            uint32_t out;
+
+            if(imp->nandOnly) {
+                // OR(a, b) = NAND(NOT a, NOT b)
+                for(size_t i = 0; i < count; i++) {
+                    inputs[i] = EmitNot(imp, inputs[i]);
+                }
+
+                out = EmitNandTree(imp, inputs, count);
+            } else {
+                out = EmitOrTree(imp, inputs, count);
+            }
+
+            return gate == GATE_OR ? out : EmitNot(imp, out);
+        }
+        case GATE_XOR:
+        case GATE_XNOR: {
+            uint32_t out = inputs[0];
+            for(size_t i = 1; i < count; i++) {
+                out = EmitXor(imp, out, inputs[i]);
+            }
+
+            return gate == GATE_XOR ? out : EmitNot(imp, out);
+        }
+        case GATE_BUF: return inputs[0];
+        case GATE_NOT: return EmitNot(imp, inputs[0]);
+    }
+
+    assert(false && "Unreachable");
+    return IMPORT_NO_NET;
+}
+
+// BLIF //
+
+// reads a line without comments joining the lines that end with '\',
+// returns false at the end of the file
+static bool ReadBlifLine(Importer *imp) {
+    StringBuilder *line = &imp->lineBuf;
+    line->count = 0;
+    imp->line = imp->reader->line;
+
+    int c = ReadChar(imp->reader);
+    if(c == EOF) return false;
+
+    for(; c != EOF; c = ReadChar(imp->reader)) {
+        if(c == '\n') {
+            if(line->count > 0 && line->items[line->count - 1] == '\\') {
+                line->count--;
+                continue;
+            }
+
+            break;
+        }
+
+        if(c == '#') {
+            while(c != EOF && c != '\n') c = ReadChar(imp->reader);
+            break;
+        }
+
+        da_append(line, (char)c);
+    }
+
+    da_append(line, '\0');
+    return true;
+}
+
+// splits the line in place
+static void SplitBlifLine(Importer *imp) {
+    imp->tokens.count = 0;
+    char *s = imp->lineBuf.items;
+
+    while(*s != '\0') {
+        while(*s != '\0' && isspace((unsigned char)*s)) s++;
+        if(*s == '\0') break;
+
+        da_append(&imp->tokens, s);
+
+        while(*s != '\0' && !isspace((unsigned char)*s)) s++;
+        if(*s != '\0') *s++ = '\0';
+    }
+}
+
+static uint32_t InternToken(Importer *imp, const char *token) {
+    return InternNet(imp, token, strlen(token));
+}
+
+// the pattern was already checked
+static void EmitCube(Importer *imp, const char *pattern) {
+    imp->terms.count = 0;
+
+    for(size_t i = 0; i < imp->namesInputs.count; i++) {
+        uint32_t net = imp->namesInputs.items[i];
+
+        if(pattern[i] == '1') da_append(&imp->terms, net);
+        if(pattern[i] == '0') da_append(&imp->terms, EmitNot(imp, net));
+    }
+
+    // with NANDs only every cube is stored negated, the cover is a NAND of them
+    uint32_t cube = imp->nandOnly
+        ? EmitNandTree(imp, imp->terms.items, imp->terms.count)
+        : EmitAndTree(imp, imp->terms.items, imp->terms.count);
+    da_append(&imp->cubes, cube);
+}
+
+static bool AddCoverRow(Importer *imp) {
+    size_t inputCount = imp->namesInputs.count;
+    size_t expectedTokens = inputCount == 0 ? 1 : 2;
+
+    if(imp->tokens.count != expectedTokens) {
+        ReportError(imp, "Invalid cover row for \"%s\"", GetNetName(imp, imp->namesOutput));
+        return false;
+    }
+
+    const char *pattern = imp->tokens.items[0];
+    const char *value = imp->tokens.items[expectedTokens - 1];
+
+    if(strlen(pattern) != inputCount && inputCount > 0) {
+        ReportError(imp, "Cover row \"%s\" doesn't match the %lu inputs of \"%s\"", pattern, inputCount, GetNetName(imp, imp->namesOutput));
+        return false;
+    }
+
+    if(strcmp(value, "0") != 0 && strcmp(value, "1") != 0) {
+        ReportError(imp, "Invalid output value \"%s\" in cover row", value);
+        return false;
+    }
+
+    int phase = value[0] - '0';
+    if(imp->namesPhase == -1) {
+        imp->namesPhase = phase;
+    } else if(imp->namesPhase != phase) {
+        ReportError(imp, "Covers mixing on-set and off-set rows are not supported");
+        return false;
+    }
+
+    for(size_t i = 0; i < inputCount; i++) {
+        if(pattern[i] != '0' && pattern[i] != '1' && pattern[i] != '-') {
+            ReportError(imp, "Invalid character '%c' in cover row", pattern[i]);
+            return false;
+        }
+    }
+
+    if(!imp->nandOnly && inputCount > 0 && inputCount <= IMPORT_MATCH_INPUTS) {
+        uint32_t care = 0;
+        uint32_t bits = 0;
+
+        for(size_t i = 0; i < inputCount; i++) {
+            if(pattern[i] != '-') care |= 1 << i;
+            if(pattern[i] == '1') bits |= 1 << i;
+        }
+
+        da_append(&imp->namesRows, care << 8 | bits);
+        return true;
+    }
+
+    EmitCube(imp, pattern);
+    return true;
+}
+
+// the truth table of the small cover, bit N is the output when the inputs are
+// the bits of N (input 0 is the least significant bit)
+static uint32_t GetCoverTable(Importer *imp) {
+    size_t inputCount = imp->namesInputs.count;
+    uint32_t table = 0;
+
+    for(uint32_t minterm = 0; minterm < (1u << inputCount); minterm++) {
+        for(size_t i = 0; i < imp->namesRows.count; i++) {
+            uint32_t care = imp->namesRows.items[i] >> 8;
+            uint32_t bits = imp->namesRows.items[i] & 0xFF;
+
+            if((minterm & care) == bits) {
+                table |= 1u << minterm;
+                break;
+            }
+        }
+    }
+
+    // off-set covers list the minterms where the output is off
+    if(imp->namesPhase == 0) table = ~table & ((1u << (1u << inputCount)) - 1);
+
+    return table;
+}
+
+// the table of "x[select] ? x[b] : x[a]" for 3 inputs
+static uint32_t GetMuxTable(size_t a, size_t b, size_t select) {
+    uint32_t table = 0;
+
+    for(uint32_t minterm = 0; minterm < 8; minterm++) {
+        size_t picked = (minterm >> select) & 1 ? b : a;
+        table |= ((minterm >> picked) & 1) << minterm;
+    }
+
+    return table;
+}
+
+// returns the net of the primitive that computes the small cover, or
+// IMPORT_NO_NET if there's none
+static uint32_t MatchCover(Importer *imp) {
+    uint32_t *x = imp->namesInputs.items;
+    uint32_t table = GetCoverTable(imp);
+
+    if(imp->namesInputs.count == 2) {
+        if(table == 0x6) return EmitXor(imp, x[0], x[1]);
+        if(table == 0x9) return EmitNot(imp, EmitXor(imp, x[0], x[1]));
+    }
+
+    if(imp->namesInputs.count == 3) {
+        if(table == 0x96) return EmitAdder(imp, x, false);
+        if(table == 0x69) return EmitNot(imp, EmitAdder(imp, x, false));
+        if(table == 0xE8) return EmitAdder(imp, x, true);
+        if(table == 0x17) return EmitNot(imp, EmitAdder(imp, x, true));
+
+        for(size_t select = 0; select < 3; select++) {
+            size_t a = (select + 1) % 3;
+            size_t b = (select + 2) % 3;
+
+            if(table == GetMuxTable(a, b, select)) return EmitMux(imp, x[a], x[b], x[select]);
+            if(table == GetMuxTable(b, a, select)) return EmitMux(imp, x[b], x[a], x[select]);
+        }
+    }
+
+    return IMPORT_NO_NET;
+}
+
+static uint32_t EmitCover(Importer *imp) {
+    if(imp->namesRows.count > 0) {
+        uint32_t out = MatchCover(imp);
+        if(out != IMPORT_NO_NET) return out;
+
+        // not a primitive, the rows are emitted as any other cover
+        for(size_t i = 0; i < imp->namesRows.count; i++) {
+            char pattern[IMPORT_MATCH_INPUTS + 1] = {0};
+            uint32_t care = imp->namesRows.items[i] >> 8;
+            uint32_t bits = imp->namesRows.items[i] & 0xFF;
+
+            for(size_t j = 0; j < imp->namesInputs.count; j++) {
+                pattern[j] = (care >> j) & 1 ? '0' + ((bits >> j) & 1) : '-';
+            }
+
+            EmitCube(imp, pattern);
+        }
+    }
+
+    if(imp->cubes.count == 0) return GetConst0(imp);
+
+    uint32_t out = imp->nandOnly
+        ? EmitNandTree(imp, imp->cubes.items, imp->cubes.count)
+        : EmitOrTree(imp, imp->cubes.items, imp->cubes.count);
+
+    return imp->namesPhase == 0 ? EmitNot(imp, out) : out;
+}
+
+static bool FinishNames(Importer *imp) {
+    return DriveNet(imp, imp->namesOutput, EmitCover(imp));
+}
+
+// .latch <input> <output> [<type> <control>] [<init>]
+static bool ParseLatch(Importer *imp) {
+    char **tokens = imp->tokens.items;
+    size_t count = imp->tokens.count;
+
+    if(count < 3 || count > 6) {
+        ReportError(imp, "Invalid .latch");
+        return false;
+    }
+
+    if(count < 5) {
+        ReportError(imp, "Latches without a clock are not supported");
+        return false;
+    }
+
+    // edge triggered (re, fe) or level sensitive (ah, al)
+    const char *type = tokens[3];
+    bool levelSensitive = strcmp(type, "ah") == 0 || strcmp(type, "al") == 0;
+    bool inverted = strcmp(type, "fe") == 0 || strcmp(type, "al") == 0;
+
+    if(!levelSensitive && !inverted && strcmp(type, "re") != 0) {
+        ReportError(imp, "Unsupported latch type \"%s\" (only \"re\", \"fe\", \"ah\" and \"al\" are supported)", type);
+        return false;
+    }
+
+    uint32_t control = InternToken(imp, tokens[4]);
+    if(inverted) control = EmitNot(imp, control);
+
+    // 0, 1, 2 (don't care) or 3 (unknown), only 1 starts on
+    bool initialValue = count == 6 && strcmp(tokens[5], "1") == 0;
+
+    uint32_t data = InternToken(imp, tokens[1]);
+    uint32_t out = levelSensitive
+        ? EmitLatch(imp, data, control, initialValue)
+        : EmitDff(imp, data, control, initialValue);
+
+    return DriveNet(imp, InternToken(imp, tokens[2]), out);
+}
+
+static bool ParseBlif(Importer *imp) {
+    bool inNames = false;
+    bool seenModel = false;
+
+    while(ReadBlifLine(imp)) {
+        SplitBlifLine(imp);
+        if(imp->tokens.count == 0) continue;
+
+        char **tokens = imp->tokens.items;
+        size_t count = imp->tokens.count;
+
+        if(tokens[0][0] != '.') {
+            if(!inNames) {
+                ReportError(imp, "Cover row outside of .names");
+                return false;
+            }
+
+            if(!AddCoverRow(imp)) return false;
+            continue;
+        }
+
+        if(inNames) {
+            if(!FinishNames(imp)) return false;
+            inNames = false;
+        }
+
+        if(strcmp(tokens[0], ".model") == 0) {
+            if(seenModel) {
+                ReportError(imp, "Only one model per file is supported");
+                return false;
+            }
+            seenModel = true;
+        } else if(strcmp(tokens[0], ".inputs") == 0) {
+            for(size_t i = 1; i < count; i++) {
+                if(!DeclareInput(imp, InternToken(imp, tokens[i]))) return false;
+            }
+        } else if(strcmp(tokens[0], ".outputs") == 0) {
+            for(size_t i = 1; i < count; i++) {
+                DeclareOutput(imp, InternToken(imp, tokens[i]));
+            }
+        } else if(strcmp(tokens[0], ".names") == 0) {
+            if(count < 2) {
+                ReportError(imp, ".names without output");
+                return false;
+            }
+
+            imp->namesInputs.count = 0;
+            for(size_t i = 1; i < count - 1; i++) {
+                da_append(&imp->namesInputs, InternToken(imp, tokens[i]));
+            }
+
+            imp->namesOutput = InternToken(imp, tokens[count - 1]);
+            imp->namesPhase = -1;
+            imp->namesRows.count = 0;
+            imp->cubes.count = 0;
+            inNames = true;
+        } else if(strcmp(tokens[0], ".latch") == 0) {
+            if(!ParseLatch(imp)) return false;
+        } else if(strcmp(tokens[0], ".end") == 0) {
+            break;
+        } else {
+            ReportError(imp, "Unsupported BLIF command \"%s\"", tokens[0]);
+            return false;
+        }
+    }
+
+    if(inNames) return FinishNames(imp);
+
+    return true;
+}
+
+// VERILOG //
+
+static bool IsNameChar(int c) {
+    return isalnum(c) || c == '_' || c == '$';
+}
+
+static bool NextToken(Importer *imp) {
+    ImportReader *reader = imp->reader;
+    int c;
+
+    // skip spaces, comments and compiler directives
+    for(;;) {
+        c = PeekChar(reader);
+
+        if(c != EOF && isspace(c)) {
+            ReadChar(reader);
+        } else if(c == '`') {
+            while(c != EOF && c != '\n') c = ReadChar(reader);
+        } else if(c == '/') {
+            ReadChar(reader);
+            int next = PeekChar(reader);
+
+            if(next == '/') {
+                while(c != EOF && c != '\n') c = ReadChar(reader);
+            } else if(next == '*') {
+                ReadChar(reader);
+                int prev = 0;
+                c = ReadChar(reader);
+                while(c != EOF && !(prev == '*' && c == '/')) {
+                    prev = c;
+                    c = ReadChar(reader);
+                }
+            } else {
+                imp->line = reader->line;
+                ReportError(imp, "Unexpected '/'");
+                return false;
+            }
+        } else {
+            break;
+        }
+    }
+
+    imp->line = reader->line;
+
+    if(c == EOF) {
+        imp->tokenType = TOKEN_END;
+        imp->token[0] = '\0';
+        return true;
+    }
+
+    size_t len = 0;
+
+    if(isalpha(c) || c == '_' || c == '\\' || isdigit(c) || c == '\'') {
+        bool escaped = c == '\\';
+        imp->tokenType = isdigit(c) || c == '\'' ? TOKEN_NUMBER : TOKEN_NAME;
+        if(escaped) ReadChar(reader);
+
+        for(c = PeekChar(reader); c != EOF; c = PeekChar(reader)) {
+            if(escaped ? isspace(c) : !(IsNameChar(c) || c == '\'')) break;
+
+            if(len + 1 >= IMPORT_MAX_TOKEN) {
+                ReportError(imp, "Token too long");
+                return false;
+            }
+
+            imp->token[len++] = ReadChar(reader);
+        }
+    } else {
+        imp->tokenType = TOKEN_PUNCT;
+        imp->token[len++] = ReadChar(reader);
+    }
+
+    imp->token[len] = '\0';
+    return true;
+}
+
+static bool IsKeyword(Importer *imp, const char *keyword) {
+    return imp->tokenType == TOKEN_NAME && strcmp(imp->token, keyword) == 0;
+}
+
+static bool IsPunct(Importer *imp, char punct) {
+    return imp->tokenType == TOKEN_PUNCT && imp->token[0] == punct;
+}
+
+static bool Expect(Importer *imp, char punct) {
+    if(!IsPunct(imp, punct)) {
+        ReportError(imp, "Expected '%c' but found \"%s\"", punct, imp->token);
+        return false;
+    }
+
+    return NextToken(imp);
+}
+
+static bool ParseNumber(Importer *imp, long *value) {
+    if(imp->tokenType != TOKEN_NUMBER) {
+        ReportError(imp, "Expected a number but found \"%s\"", imp->token);
+        return false;
+    }
+
+    // sized constants like 1'b0 are only valid for 0 and 1
+    const char *digits = imp->token;
+    const char *quote = strchr(digits, '\'');
+    int base = 10;
+
+    if(quote != NULL) {
+        switch(tolower(quote[1])) {
+            case 'b': base = 2; break;
+            case 'o': base = 8; break;
+            case 'd': base = 10; break;
+            case 'h': base = 16; break;
+            default:
+                ReportError(imp, "Invalid constant \"%s\"", imp->token);
+                return false;
+        }
+        digits = quote + 2;
+    }
+
+    char *end;
+    *value = strtol(digits, &end, base);
+
+    if(*digits == '\0' || *end != '\0') {
+        ReportError(imp, "Invalid constant \"%s\"", imp->token);
+        return false;
+    }
+
+    return NextToken(imp);
+}
+
+// parses a name, a bit select like "a[3]" or a constant
+static bool ParseTerm(Importer *imp, uint32_t *net) {
+    if(imp->tokenType == TOKEN_NUMBER) {
+        long value;
+        if(!ParseNumber(imp, &value)) return false;
+
+        if(value != 0 && value != 1) {
+            ReportError(imp, "Only single bit constants are supported");
+            return false;
+        }
+
+        *net = value ? GetConst1(imp) : GetConst0(imp);
+        return true;
+    }
+
+    if(imp->tokenType != TOKEN_NAME) {
+        ReportError(imp, "Expected a net but found \"%s\"", imp->token);
+        return false;
+    }
+
+    char name[IMPORT_MAX_TOKEN + 32];
+    size_t len = strlen(imp->token);
+    memcpy(name, imp->token, len + 1);
+
+    if(!NextToken(imp)) return false;
+
+    if(IsPunct(imp, '[')) {
+        long bit;
+        if(!NextToken(imp) || !ParseNumber(imp, &bit)) return false;
+        if(!Expect(imp, ']')) return false;
+
+        len += snprintf(name + len, sizeof(name) - len, "[%ld]", bit);
+    }
+
+    *net = InternNet(imp, name, len);
+    return true;
+}
+
+static bool DeclareNet(Importer *imp, ImportDecl decl, const char *name, size_t len) {
+    uint32_t net = InternNet(imp, name, len);
+
+    switch(decl) {
+        case DECL_INPUT: return DeclareInput(imp, net);
+        case DECL_OUTPUT: DeclareOutput(imp, net); return true;
+        case DECL_WIRE:
+        case DECL_NONE: return true;
+    }
+
+    return true;
+}
+
+// declares the current name with every bit of the range (if any)
+static bool DeclareNames(Importer *imp, ImportDecl decl, bool hasRange, long msb, long lsb) {
+    if(imp->tokenType != TOKEN_NAME) {
+        ReportError(imp, "Expected a name but found \"%s\"", imp->token);
+        return false;
+    }
+
+    if(!hasRange) {
+        if(!DeclareNet(imp, decl, imp->token, strlen(imp->token))) return false;
+        return NextToken(imp);
+    }
+
+    long step = msb >= lsb ? -1 : 1;
+    for(long bit = msb; ; bit += step) {
+        char name[IMPORT_MAX_TOKEN + 32];
+        int len = snprintf(name, sizeof(name), "%s[%ld]", imp->token, bit);
+        if(!DeclareNet(imp, decl, name, len)) return false;
+
+        if(bit == lsb) break;
+    }
+
+    return NextToken(imp);
+}
+
+static bool ParseRange(Importer *imp, bool *hasRange, long *msb, long *lsb) {
+    *hasRange = IsPunct(imp, '[');
+    if(!*hasRange) return true;
+
+    return NextToken(imp) &&
+        ParseNumber(imp, msb) &&
+        Expect(imp, ':') &&
+        ParseNumber(imp, lsb) &&
+        Expect(imp, ']');
+}
+
+static bool GetDecl(Importer *imp, ImportDecl *decl) {
+    if(IsKeyword(imp, "input")) *decl = DECL_INPUT;
+    else if(IsKeyword(imp, "output")) *decl = DECL_OUTPUT;
+    else if(IsKeyword(imp, "wire")) *decl = DECL_WIRE;
+    else return false;
+
+    return true;
+}
+
+static bool GetGate(Importer *imp, ImportGate *gate) {
+    static const struct {
+        const char *name;
+        ImportGate gate;
+    } gates[] = {
+        {"and", GATE_AND},
+        {"nand", GATE_NAND},
+        {"or", GATE_OR},
+        {"nor", GATE_NOR},
+        {"xor", GATE_XOR},
+        {"xnor", GATE_XNOR},
+        {"buf", GATE_BUF},
+        {"not", GATE_NOT},
+    };
+
+    for(size_t i = 0; i < sizeof(gates)/sizeof(gates[0]); i++) {
+        if(IsKeyword(imp, gates[i].name)) {
+            *gate = gates[i].gate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool ParsePortList(Importer *imp) {
+    ImportDecl decl = DECL_NONE;
+    bool hasRange = false;
+    long msb = 0, lsb = 0;
+
+    if(!Expect(imp, '(')) return false;
+
+    while(!IsPunct(imp, ')')) {
+        if(IsKeyword(imp, "inout")) {
+            ReportError(imp, "inout ports are not supported");
+            return false;
+        }
+
+        if(GetDecl(imp, &decl)) {
+            if(!NextToken(imp)) return false;
+            if(IsKeyword(imp, "wire") && !NextToken(imp)) return false;
+            if(!ParseRange(imp, &hasRange, &msb, &lsb)) return false;
+        } else if(IsPunct(imp, ',')) {
+            if(!NextToken(imp)) return false;
+        } else {
+            // in non-ANSI headers the ports are declared later in the body
+            if(!DeclareNames(imp, decl, hasRange, msb, lsb)) return false;
+        }
+    }
+
+    return NextToken(imp);
+}
+
+static bool ParseDeclaration(Importer *imp, ImportDecl decl) {
+    bool hasRange;
+    long msb, lsb;
+
+    if(!NextToken(imp)) return false;
+    if(IsKeyword(imp, "wire") && !NextToken(imp)) return false;
+    if(!ParseRange(imp, &hasRange, &msb, &lsb)) return false;
+
+    for(;;) {
+        if(!DeclareNames(imp, decl, hasRange, msb, lsb)) return false;
+        if(!IsPunct(imp, ',')) break;
+        if(!NextToken(imp)) return false;
+    }
+
+    return Expect(imp, ';');
+}
+
+static bool ParseAssign(Importer *imp) {
+    if(!NextToken(imp)) return false;
+
+    for(;;) {
+        uint32_t dst, src;
+        if(!ParseTerm(imp, &dst) || !Expect(imp, '=')) return false;
+
+        bool negate = IsPunct(imp, '~');
+        if(negate && !NextToken(imp)) return false;
+
+        if(!ParseTerm(imp, &src)) return false;
+        if(negate) src = EmitNot(imp, src);
+
+        if(!DriveNet(imp, dst, src)) return false;
+
+        if(!IsPunct(imp, ',')) break;
+        if(!NextToken(imp)) return false;
+    }
+
+    return Expect(imp, ';');
+}
+
+static bool ParseGateInstance(Importer *imp, ImportGate gate) {
+    // optional instance name
+    if(imp->tokenType == TOKEN_NAME && !NextToken(imp)) return false;
+
+    if(!Expect(imp, '(')) return false;
+
+    imp->terms.count = 0;
+    for(;;) {
+        uint32_t net;
+        if(!ParseTerm(imp, &net)) return false;
+        da_append(&imp->terms, net);
+
+        if(!IsPunct(imp, ',')) break;
+        if(!NextToken(imp)) return false;
+    }
+
+    if(!Expect(imp, ')')) return false;
+
+    size_t count = imp->terms.count;
+    if(count < 2) {
+        ReportError(imp, "Gate needs at least one output and one input");
+        return false;
+    }
+
+    uint32_t *terms = imp->terms.items;
+
+    if(gate == GATE_BUF || gate == GATE_NOT) {
+        // buf and not can have many outputs, the input is the last terminal
+        uint32_t out = EmitGate(imp, gate, &terms[count - 1], 1);
+
+        for(size_t i = 0; i < count - 1; i++) {
+            if(!DriveNet(imp, terms[i], out)) return false;
+        }
+
+        return true;
+    }
+
+    uint32_t out = EmitGate(imp, gate, &terms[1], count - 1);
+    return DriveNet(imp, terms[0], out);
+}
+
+static bool ParseGate(Importer *imp, ImportGate gate) {
+    if(!NextToken(imp)) return false;
+
+    // delays are ignored
+    if(IsPunct(imp, '#')) {
+        long delay;
+        if(!NextToken(imp) || !ParseNumber(imp, &delay)) return false;
+    }
+
+    for(;;) {
+        if(!ParseGateInstance(imp, gate)) return false;
+        if(!IsPunct(imp, ',')) break;
+        if(!NextToken(imp)) return false;
+    }
+
+    return Expect(imp, ';');
+}
+
+static bool ParseModuleItem(Importer *imp) {
+    ImportDecl decl;
+    ImportGate gate;
+
+    if(GetDecl(imp, &decl)) return ParseDeclaration(imp, decl);
+    if(GetGate(imp, &gate)) return ParseGate(imp, gate);
+    if(IsKeyword(imp, "assign")) return ParseAssign(imp);
+
+    if(imp->tokenType == TOKEN_NAME) {
+        ReportError(imp, "Unsupported statement \"%s\" (module instances and behavioral code are not supported)", imp->token);
+    } else {
+        ReportError(imp, "Unexpected \"%s\"", imp->token);
+    }
+
+    return false;
+}
+
+static bool ParseVerilog(Importer *imp) {
+    if(!NextToken(imp)) return false;
+
+    if(!IsKeyword(imp, "module")) {
+        ReportError(imp, "Expected \"module\" but found \"%s\"", imp->token);
+        return false;
+    }
+
+    // module name
+    if(!NextToken(imp) || !NextToken(imp)) return false;
+
+    if(IsPunct(imp, '(') && !ParsePortList(imp)) return false;
+    if(!Expect(imp, ';')) return false;
+
+    while(!IsKeyword(imp, "endmodule")) {
+        if(imp->tokenType == TOKEN_END) {
+            ReportError(imp, "Missing \"endmodule\"");
+            return false;
+        }
+
+        if(!ParseModuleItem(imp)) return false;
+    }
+
+    if(!NextToken(imp)) return false;
+
+    if(imp->tokenType != TOKEN_END) {
+        ReportError(imp, "Only one module per file is supported");
+        return false;
+    }
+
+    return true;
+}
+
+// IMPORTER //
+
+static bool ConnectSinks(Importer *imp) {
+    size_t undriven = 0;
+    uint32_t firstUndriven = IMPORT_NO_NET;
+
+    for(size_t i = 0; i < imp->sinks.count; i++) {
+        ImportSink sink = imp->sinks.items[i];
+        SimPin *driver = ResolveDriver(imp, sink.net);
+
+        if(driver == NULL) {
+            if(undriven++ == 0) firstUndriven = sink.net;
+            continue;
+        }
+
+        SimBuildConnect(driver, sink.pin);
+        imp->result->connectionCount++;
+    }
+
+    if(undriven > 0) {
+        printf("[WARNING]: %s: %lu pins are connected to nets without driver (e.g. \"%s\"), they will stay off\n",
+            imp->path, undriven, GetNetName(imp, firstUndriven));
+    }
+
+    return true;
+}
+
+static bool ImportFile(const char *path, ImportResult *result, bool (*parse)(Importer*)) {
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        log_error("Couldn't open \"%s\": %s", path, strerror(errno));
+        return false;
+    }
+
+    *result = (ImportResult){0};
+
+    Importer imp = {
+        .path = path,
+        .line = 1,
+        .result = result,
+        .const1 = IMPORT_NO_NET,
+        .nandOnly = nandOnly,
+    };
+
+    imp.reader = calloc(1, sizeof(ImportReader));
+    assert(imp.reader != NULL && "No enough ram");
+    imp.reader->file = file;
+    imp.reader->line = 1;
+
+    imp.names = arena_create(IMPORT_NAMES_REGION_SIZE);
+
+    // the chips of the import are the ones added after this, nothing is
+    // destroyed while building
+    size_t firstChip = SimGetChipCount();
+
+    SimBuildBegin();
+
+    bool ok = parse(&imp) && ConnectSinks(&imp);
+
+    // the build is finished even on failure, so the simulation isn't left in build mode
+    SimBuildEnd();
+
+    fclose(file);
+    free(imp.reader);
+    arena_free(imp.names);
+    da_free(&imp.nets);
+    da_free(&imp.table);
+    da_free(&imp.sinks);
+    da_free(&imp.terms);
+    da_free(&imp.cubes);
+    da_free(&imp.lineBuf);
+    da_free(&imp.tokens);
+    da_free(&imp.namesInputs);
+    da_free(&imp.namesRows);
+    da_free(&imp.adders);
+
+    if(!ok) {
+        // the last chip is removed without moving any other
+        while(SimGetChipCount() > firstChip) {
+            SimDestroyChip(SimGetChip(SimGetChipCount() - 1));
+        }
+
+        ImportResultFree(result);
+    }
+
+    return ok;
+}
+
+bool ImportBlif(const char *path, ImportResult *result) {
+    return ImportFile(path, result, ParseBlif);
+}
+
+bool ImportVerilog(const char *path, ImportResult *result) {
+    return ImportFile(path, result, ParseVerilog);
+}
+
+bool ImportNetlist(const char *path, ImportResult *result) {
+    const char *ext = strrchr(path, '.');
+
+    if(ext != NULL && strcmp(ext, ".blif") == 0) return ImportBlif(path, result);
+    if(ext != NULL && strcmp(ext, ".v") == 0) return ImportVerilog(path, result);
+
+    log_error("Unknown netlist format \"%s\" (expected .blif or .v)", path);
+    return false;
+}
+
+void ImportResultFree(ImportResult *result) {
+    for(size_t i = 0; i < result->inputs.count; i++) {
+        free(result->inputs.items[i].name);
+    }
+
+    for(size_t i = 0; i < result->outputs.count; i++) {
+        free(result->outputs.items[i].name);
+    }
+
+    da_free(&result->inputs);
+    da_free(&result->outputs);
+
+    *result = (ImportResult){0};
+}
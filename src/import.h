@@ -0,0 +1,49 @@
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include "simulation.h"
+
+typedef struct {
+    char *name;
+    SimChip *chip;
+} ImportPort;
+
+typedef struct {
+    ImportPort *items;
+    size_t count;
+    size_t capacity;
+} ImportPortArr;
+
+typedef struct {
+    ImportPortArr inputs; // one CHIP_INPUT per primary input
+    ImportPortArr outputs; // one CHIP_LED per primary output
+
+    size_t chipCount;
+    size_t connectionCount;
+} ImportResult;
+
+// Imports a netlist into the simulation, the format is picked with the
+// extension of the file: ".blif" for BLIF and ".v" for structural Verilog.
+// The file is read in chunks and the circuit is created with the bulk builder
+// (SimBuildBegin/SimBuildEnd). Returns false and logs the error on failure, the
+// chips created before the error are destroyed.
+bool ImportNetlist(const char *path, ImportResult *result);
+
+// By default the gates become the single bit primitives of the simulation
+// (AND, OR, XOR, NOT, MUX and full adders, small BLIF covers are matched
+// against them). With "enabled" everything is built from 2 input NANDs
+// instead, like in the hardware classes. Flip-flops are always native.
+void ImportSetNandOnly(bool enabled);
+
+// Edge triggered latches (".latch" with a "re" or "fe" clock) become D flip-flops
+// and the level sensitive ones ("ah" or "al") become latches
+bool ImportBlif(const char *path, ImportResult *result);
+
+// Only the gate level subset is supported: a single module with
+// input/output/wire declarations, the and/nand/or/nor/xor/xnor/not/buf
+// primitives and "assign" of a net, a negated net or a constant.
+bool ImportVerilog(const char *path, ImportResult *result);
+
+void ImportResultFree(ImportResult *result);
+
+#endif // IMPORT_H
@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "journal.h"
+#include "CCFuncs.h"
+
+#define JOURNAL_MAGIC "LSJ1"
+#define JOURNAL_BUFFER_SIZE (1 << 16)
+
+// every record starts with its tag and the events evaluated since the
+// previous record, the numbers are stored as LEB128 varints
+typedef enum {
+    JOURNAL_END,
+    JOURNAL_SET_INPUT, // chip, pin, value
+    JOURNAL_SET_OUTPUT, // chip, pin, value, unknown
+    JOURNAL_RUN_CYCLE, // one cycle of SimRunCycles
+} JournalTag;
+
+typedef struct {
+    FILE *file;
+    uint64_t lastEvents; // event count of the last record
+} JournalState;
+
+static JournalState state = {0};
+
+static void WriteVarint(FILE *file, uint64_t value) {
+    while(value >= 0x80) {
+        fputc((value & 0x7F) | 0x80, file);
+        value >>= 7;
+    }
+
+    fputc(value, file);
+}
+
+static bool ReadVarint(FILE *file, uint64_t *value) {
+    *value = 0;
+
+    for(int shift = 0; shift < 64; shift += 7) {
+        int byte = fgetc(file);
+        if(byte == EOF) return false;
+
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if((byte & 0x80) == 0) return true;
+    }
+
+    return false;
+}
+
+static void WriteEvents(void) {
+    uint64_t events = SimGetEventCount();
+    WriteVarint(state.file, events - state.lastEvents);
+    state.lastEvents = events;
+}
+
+static void RecordStimulus(SimChip *chip, bool isInput, size_t index, uint64_t value, uint64_t unknown) {
+    fputc(isInput ? JOURNAL_SET_INPUT : JOURNAL_SET_OUTPUT, state.file);
+    WriteEvents();
+    WriteVarint(state.file, chip->index);
+    WriteVarint(state.file, index);
+    WriteVarint(state.file, value);
+    if(!isInput) WriteVarint(state.file, unknown);
+}
+
+static void RecordCycle(void) {
+    fputc(JOURNAL_RUN_CYCLE, state.file);
+    WriteEvents();
+}
+
+bool JournalStart(const char *path) {
+    assert(state.file == NULL && "The journal is already recording");
+
+    state.file = fopen(path, "wb");
+    if(state.file == NULL) {
+        log_error("Couldn't open \"%s\"", path);
+        return false;
+    }
+
+    setvbuf(state.file, NULL, _IOFBF, JOURNAL_BUFFER_SIZE);
+
+    fwrite(JOURNAL_MAGIC, 1, strlen(JOURNAL_MAGIC), state.file);
+    fputc(SimGetEngine(), state.file);
+    fputc(SimGetFourState(), state.file);
+    WriteVarint(state.file, SimGetChipCount());
+    WriteVarint(state.file, SimGetStateSlotCount());
+
+    state.lastEvents = SimGetEventCount();
+    SimSetStimulusHook(RecordStimulus);
+    SimSetCycleHook(RecordCycle);
+
+    return true;
+}
+
+void JournalStop(void) {
+    if(state.file == NULL) return;
+
+    SimSetStimulusHook(NULL);
+    SimSetCycleHook(NULL);
+
+    fputc(JOURNAL_END, state.file);
+    WriteEvents();
+
+    fclose(state.file);
+    state = (JournalState){0};
+}
+
+bool JournalIsRecording(void) {
+    return state.file != NULL;
+}
+
+static bool ReadHeader(FILE *file, const char *path) {
+    char magic[sizeof(JOURNAL_MAGIC)] = {0};
+    if(fread(magic, 1, strlen(JOURNAL_MAGIC), file) != strlen(JOURNAL_MAGIC) || strcmp(magic, JOURNAL_MAGIC) != 0) {
+        log_error("\"%s\" isn't a journal", path);
+        return false;
+    }
+
+    int engine = fgetc(file);
+    int fourState = fgetc(file);
+    uint64_t chipCount, slotCount;
+
+    if(engine == EOF || fourState == EOF || !ReadVarint(file, &chipCount) || !ReadVarint(file, &slotCount)) {
+        log_error("The journal \"%s\" is truncated", path);
+        return false;
+    }
+
+    if(chipCount != SimGetChipCount() || slotCount != SimGetStateSlotCount()) {
+        log_error("The journal was recorded on another circuit (%lu chips, the current one has %lu)",
+            chipCount, SimGetChipCount());
+        return false;
+    }
+
+    if((bool)fourState != SimGetFourState()) {
+        log_error("The journal was recorded in %s state mode", fourState ? "four" : "two");
+        return false;
+    }
+
+    return SimSetEngine(engine);
+}
+
+// runs the simulation until "events" events were evaluated since "start"
+static bool RunTo(uint64_t start, uint64_t events) {
+    uint64_t target = start + events;
+    uint64_t current = SimGetEventCount();
+
+    if(current < target) SimRun(0, target - current);
+
+    if(SimGetEventCount() != target) {
+        log_error("The replay diverged from the journal at event %lu", events);
+        return false;
+    }
+
+    return true;
+}
+
+static bool ReplayRecords(FILE *file, JournalReplayStats *stats) {
+    uint64_t start = SimGetEventCount();
+
+    while(true) {
+        int tag = fgetc(file);
+        uint64_t delta;
+
+        if(tag == EOF || !ReadVarint(file, &delta)) {
+            log_error("The journal is truncated after %lu records", stats->records);
+            return false;
+        }
+
+        stats->events += delta;
+        if(!RunTo(start, stats->events)) return false;
+
+        if(tag == JOURNAL_END) return true;
+
+        if(tag == JOURNAL_RUN_CYCLE) {
+            // the recording ran it, it can only fail on another circuit
+            if(SimRunCycles(1) != 1) {
+                log_error("The replay couldn't run the cycle of record #%lu", stats->records);
+                return false;
+            }
+
+            stats->records++;
+            continue;
+        }
+
+        uint64_t chipIndex, pin, value, unknown = 0;
+        bool ok = ReadVarint(file, &chipIndex) && ReadVarint(file, &pin) && ReadVarint(file, &value);
+        if(ok && tag == JOURNAL_SET_OUTPUT) ok = ReadVarint(file, &unknown);
+
+        if(!ok || (tag != JOURNAL_SET_INPUT && tag != JOURNAL_SET_OUTPUT) || chipIndex >= SimGetChipCount()) {
+            log_error("Invalid record #%lu in the journal", stats->records);
+            return false;
+        }
+
+        SimChip *chip = SimGetChip(chipIndex);
+        size_t pinCount = tag == JOURNAL_SET_INPUT ? chip->inputs.count : chip->outputs.count;
+
+        if(pin >= pinCount) {
+            log_error("Invalid record #%lu in the journal", stats->records);
+            return false;
+        }
+
+        if(tag == JOURNAL_SET_INPUT) {
+            SimSetInputPinState(chip, pin, value);
+        } else {
+            SimSetOutputPinPlanes(chip, pin, value, unknown);
+        }
+
+        stats->records++;
+    }
+}
+
+bool JournalReplay(const char *path, JournalReplayStats *stats) {
+    assert(state.file == NULL && "The journal can't be replayed while recording");
+
+    *stats = (JournalReplayStats){0};
+
+    FILE *file = fopen(path, "rb");
+    if(file == NULL) {
+        log_error("Couldn't open \"%s\"", path);
+        return false;
+    }
+
+    setvbuf(file, NULL, _IOFBF, JOURNAL_BUFFER_SIZE);
+
+    bool autoSettle = SimGetAutoSettle();
+    SimSetAutoSettle(false);
+
+    bool ok = ReadHeader(file, path) && ReplayRecords(file, stats);
+
+    SimSetAutoSettle(autoSettle);
+    fclose(file);
+
+    return ok;
+}
@@ -0,0 +1,33 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "simulation.h"
+
+// Journal of the stimulus of a session: every pin set from outside the
+// simulation (see SimSetStimulusHook) and every cycle run by SimRunCycles is
+// appended to a file with the number of events evaluated before it
+// (SimGetEventCount). The simulation is
+// deterministic, so applying the same sets at the same event counts to the
+// same circuit reproduces the session exactly, without the pauses of the GUI.
+//
+// The journal doesn't record the circuit: the chips are saved by their
+// position (SimChip.index) and the replay must be done on a circuit built in
+// the same way. The circuit can't change while recording.
+
+// starts recording into "path" (truncated), returns false if it can't be opened
+bool JournalStart(const char *path);
+// writes the final event count and closes the file
+void JournalStop(void);
+bool JournalIsRecording(void);
+
+typedef struct {
+    size_t records; // pin sets and cycles applied
+    uint64_t events; // event count at the end of the journal
+} JournalReplayStats;
+
+// Replays the journal on the current simulation as fast as possible, the
+// engine and the logic mode are set to the ones of the recording. Returns
+// false and logs the error if the journal doesn't match the circuit.
+bool JournalReplay(const char *path, JournalReplayStats *stats);
+
+#endif // JOURNAL_H
@@ -1,16 +1,38 @@
 #include <assert.h>
+#include <time.h>
 #include "raylib.h"
 #include "raymath.h"
 
+#define CCFUNCS_IMPLEMENTATION
 #include "CCFuncs.h"
 
 #include "simulation.h"
 #include "visual.h"
+#include "import.h"
+#include "fault.h"
+#include "equiv.h"
+#include "bdd.h"
+#include "simthread.h"
+#include "journal.h"
+#include "coverage.h"
+#include "activity.h"
+#include "timing.h"
 
 #define NAND_WIDTH 120
 #define NAND_HEIGHT 40
 #define PIN_RADIUS 8
 
+#define EQUIV_DEFAULT_VECTORS 1000000000
+#define COVERAGE_REPORT_CHIPS 20
+#define ACTIVITY_REPORT_CHIPS 20
+#define TIMING_DEFAULT_PATHS 10
+
+#define TARGET_FPS 60
+// without the simulation thread every frame simulates during this part of
+// the time left after drawing the previous one, but at least FRAME_MIN_BUDGET
+#define FRAME_BUDGET_SHARE 0.8
+#define FRAME_MIN_BUDGET 0.001
+
 typedef struct Nand Nand;
 typedef struct Pin Pin;
 
@@ -223,32 +245,598 @@ void ConnectPin(Pin *outPin, Pin *inPin) {
     da_append(&outPin->targets, inPin);
 }
 
-int main(void) {
-    InitWindow(1280, 720, "Logic Simulator");
-    SetTargetFPS(60);
+static double GetSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-    Nand *nand_1 = CreateNand(100, 100);
-    Nand *nand_2 = CreateNand(300, 100);
-    (void) nand_1;
-    (void) nand_2;
+static int ImportCommand(const char *path) {
+    ImportResult result;
+    double start = GetSeconds();
+
+    if(!ImportNetlist(path, &result)) {
+        SimDestroy();
+        return 1;
+    }
+
+    printf("Imported \"%s\" in %.3fs\n", path, GetSeconds() - start);
+    printf("  chips: %lu\n", result.chipCount);
+    printf("  connections: %lu\n", result.connectionCount);
+    printf("  inputs: %lu\n", result.inputs.count);
+    printf("  outputs: %lu\n", result.outputs.count);
+
+    ImportResultFree(&result);
+    SimDestroy();
+
+    return 0;
+}
+
+// the chips of the ports, in the same order
+static SimChip **GetPortChips(ImportPortArr ports) {
+    SimChip **chips = malloc((ports.count > 0 ? ports.count : 1)*sizeof(SimChip*));
+    assert(chips != NULL && "No enough ram");
+
+    for(size_t i = 0; i < ports.count; i++) {
+        chips[i] = ports.items[i].chip;
+    }
+
+    return chips;
+}
+
+static int FaultsCommand(const char *path, const char *vectorsPath) {
+    ImportResult result;
+    if(!ImportNetlist(path, &result)) {
+        SimDestroy();
+        return 1;
+    }
+
+    FaultVectors vectors;
+    if(!FaultLoadVectors(vectorsPath, result.inputs.count, &vectors)) {
+        ImportResultFree(&result);
+        SimDestroy();
+        return 1;
+    }
+
+    SimChip **inputs = GetPortChips(result.inputs);
+    SimChip **outputs = GetPortChips(result.outputs);
+
+    double start = GetSeconds();
+
+    FaultReport report;
+    bool ok = FaultSimulate(inputs, result.inputs.count, outputs, result.outputs.count, &vectors, &report);
+
+    if(ok) {
+        FaultPrintReport(&report, 20);
+        printf("Simulated in %.3fs\n", GetSeconds() - start);
+    }
+
+    FaultReportFree(&report);
+    free(inputs);
+    free(outputs);
+    da_free(&vectors);
+    ImportResultFree(&result);
+    SimDestroy();
+
+    return ok ? 0 : 1;
+}
+
+// pairs every port of "a" with the port of "b" that has the same name
+static EquivPort *MatchPorts(ImportPortArr a, ImportPortArr b, const char *kind) {
+    if(a.count != b.count) {
+        log_error("The circuits have a different number of %s (%lu and %lu)", kind, a.count, b.count);
+        return NULL;
+    }
+
+    EquivPort *ports = malloc((a.count > 0 ? a.count : 1)*sizeof(EquivPort));
+    assert(ports != NULL && "No enough ram");
+
+    for(size_t i = 0; i < a.count; i++) {
+        ports[i] = (EquivPort){a.items[i].chip, NULL};
+
+        for(size_t j = 0; j < b.count; j++) {
+            if(strcmp(a.items[i].name, b.items[j].name) == 0) {
+                ports[i].b = b.items[j].chip;
+                break;
+            }
+        }
+
+        if(ports[i].b == NULL) {
+            log_error("The %s \"%s\" is missing in the second circuit", kind, a.items[i].name);
+            free(ports);
+            return NULL;
+        }
+    }
+
+    return ports;
+}
+
+static int EquivCommand(const char *pathA, const char *pathB, uint64_t vectorCount) {
+    // both circuits are imported in the same simulation
+    ImportResult a, b;
+    if(!ImportNetlist(pathA, &a)) {
+        SimDestroy();
+        return 1;
+    }
+
+    if(!ImportNetlist(pathB, &b)) {
+        ImportResultFree(&a);
+        SimDestroy();
+        return 1;
+    }
+
+    EquivPort *inputs = MatchPorts(a.inputs, b.inputs, "inputs");
+    EquivPort *outputs = inputs != NULL ? MatchPorts(a.outputs, b.outputs, "outputs") : NULL;
+
+    EquivResult result = {0};
+    bool ok = inputs != NULL && outputs != NULL;
+
+    if(ok) {
+        double start = GetSeconds();
+        ok = EquivCheck(inputs, a.inputs.count, outputs, a.outputs.count, vectorCount, time(NULL), &result);
+
+        if(ok) {
+            double elapsed = GetSeconds() - start;
+            printf("Checked %lu random vectors in %.3fs\n", result.checked, elapsed);
+        }
+    }
+
+    if(ok && result.mismatch) {
+        printf("Mismatch at vector %lu:\n", result.vector);
+
+        for(size_t i = 0; i < a.inputs.count; i++) {
+            printf("  input  %s = %d\n", a.inputs.items[i].name, result.inputs[i]);
+        }
+
+        for(size_t i = 0; i < a.outputs.count; i++) {
+            printf("  output %s = %d / %d%s\n", a.outputs.items[i].name,
+                result.outputsA[i], result.outputsB[i], result.outputsA[i] != result.outputsB[i] ? " (differs)" : "");
+        }
+    } else if(ok) {
+        printf("No mismatches found\n");
+    }
+
+    bool equivalent = ok && !result.mismatch;
+
+    EquivResultFree(&result);
+    free(inputs);
+    free(outputs);
+    ImportResultFree(&a);
+    ImportResultFree(&b);
+    SimDestroy();
+
+    return equivalent ? 0 : 1;
+}
+
+static int TruthCommand(const char *path) {
+    ImportResult result;
+    if(!ImportNetlist(path, &result)) {
+        SimDestroy();
+        return 1;
+    }
+
+    SimChip **inputs = GetPortChips(result.inputs);
+    SimChip **outputs = GetPortChips(result.outputs);
+    BddNode *nodes = malloc((result.outputs.count > 0 ? result.outputs.count : 1)*sizeof(BddNode));
+    assert(nodes != NULL && "No enough ram");
+
+    BddManager *bdd = BddCreate(result.inputs.count);
+    bool ok = BddBuildCircuit(bdd, inputs, result.inputs.count, outputs, result.outputs.count, nodes);
+
+    if(ok) {
+        printf("# inputs:");
+        for(size_t i = 0; i < result.inputs.count; i++) printf(" %s", result.inputs.items[i].name);
+        printf("\n");
+
+        for(size_t i = 0; i < result.outputs.count; i++) {
+            printf("# %s: %.0f of %.0f assignments are 1\n", result.outputs.items[i].name,
+                BddSatCount(bdd, nodes[i]), BddSatCount(bdd, BDD_TRUE));
+            BddPrintCubes(bdd, nodes[i]);
+        }
+    }
+
+    BddDestroy(bdd);
+    free(nodes);
+    free(inputs);
+    free(outputs);
+    ImportResultFree(&result);
+    SimDestroy();
+
+    return ok ? 0 : 1;
+}
+
+// Applies the vectors and reports the toggle coverage. With a coverage file
+// the coverage of the previous runs in it is merged first and the file is
+// updated with the result.
+static int CoverageCommand(const char *path, const char *vectorsPath, const char *coveragePath) {
+    ImportResult result;
+    if(!ImportNetlist(path, &result)) {
+        SimDestroy();
+        return 1;
+    }
+
+    FaultVectors vectors;
+    if(!FaultLoadVectors(vectorsPath, result.inputs.count, &vectors)) {
+        ImportResultFree(&result);
+        SimDestroy();
+        return 1;
+    }
+
+    SimCoverageEnable();
+    bool ok = true;
+
+    if(coveragePath != NULL && FileExists(coveragePath)) ok = CoverageMerge(coveragePath);
+
+    size_t inputCount = result.inputs.count;
+    size_t vectorCount = inputCount > 0 ? vectors.count / inputCount : 0;
+    double start = GetSeconds();
+
+    SimSetAutoSettle(false);
+
+    for(size_t v = 0; v < vectorCount && ok; v++) {
+        for(size_t i = 0; i < inputCount; i++) {
+            SimSetOutputPinState(result.inputs.items[i].chip, 0, vectors.items[v*inputCount + i]);
+        }
+
+        ok = SimSettle();
+    }
+
+    if(ok) {
+        CoveragePrintReport(COVERAGE_REPORT_CHIPS);
+        printf("Simulated %lu vectors in %.3fs\n", vectorCount, GetSeconds() - start);
+
+        if(coveragePath != NULL) ok = CoverageSave(coveragePath);
+    }
+
+    da_free(&vectors);
+    ImportResultFree(&result);
+    SimDestroy();
+
+    return ok ? 0 : 1;
+}
+
+// Applies the vectors and reports the switching activity of the chips, the
+// settle after building the circuit isn't counted
+static int ActivityCommand(const char *path, const char *vectorsPath) {
+    ImportResult result;
+    if(!ImportNetlist(path, &result)) {
+        SimDestroy();
+        return 1;
+    }
+
+    FaultVectors vectors;
+    if(!FaultLoadVectors(vectorsPath, result.inputs.count, &vectors)) {
+        ImportResultFree(&result);
+        SimDestroy();
+        return 1;
+    }
+
+    SimActivityEnable();
+    SimSetAutoSettle(false);
+
+    size_t inputCount = result.inputs.count;
+    size_t vectorCount = inputCount > 0 ? vectors.count / inputCount : 0;
+    double start = GetSeconds();
+    bool ok = true;
+
+    for(size_t v = 0; v < vectorCount && ok; v++) {
+        for(size_t i = 0; i < inputCount; i++) {
+            SimSetOutputPinState(result.inputs.items[i].chip, 0, vectors.items[v*inputCount + i]);
+        }
+
+        ok = SimSettle();
+    }
+
+    if(ok) {
+        double seconds = GetSeconds() - start;
+
+        ActivityReport report;
+        ActivityBuildReport(&report);
+        ActivityPrintReport(&report, vectorCount, ACTIVITY_REPORT_CHIPS);
+        ActivityReportFree(&report);
+
+        printf("Simulated %lu vectors in %.3fs (%lu events)\n", vectorCount, seconds, SimGetEventCount());
+    }
 
+    da_free(&vectors);
+    ImportResultFree(&result);
+    SimDestroy();
+
+    return ok ? 0 : 1;
+}
+
+static int TimingCommand(const char *path, size_t maxPaths) {
+    ImportResult result;
+    if(!ImportNetlist(path, &result)) {
+        SimDestroy();
+        return 1;
+    }
+
+    double start = GetSeconds();
+
+    TimingReport report;
+    TimingAnalyze(NULL, maxPaths, &report);
+    double seconds = GetSeconds() - start;
+
+    TimingPrintReport(&report);
+    printf("Analyzed %lu chips in %.3fs\n", report.chipCount, seconds);
+
+    TimingReportFree(&report);
+    ImportResultFree(&result);
+    SimDestroy();
+
+    return 0;
+}
+
+// the ports of "b" in the order of the ports of "a"
+static SimChip **GetMatchedChips(EquivPort *ports, size_t count, bool second) {
+    SimChip **chips = malloc((count > 0 ? count : 1)*sizeof(SimChip*));
+    assert(chips != NULL && "No enough ram");
+
+    for(size_t i = 0; i < count; i++) {
+        chips[i] = second ? ports[i].b : ports[i].a;
+    }
+
+    return chips;
+}
+
+static int ProveCommand(const char *pathA, const char *pathB) {
+    ImportResult a, b;
+    if(!ImportNetlist(pathA, &a)) {
+        SimDestroy();
+        return 1;
+    }
+
+    if(!ImportNetlist(pathB, &b)) {
+        ImportResultFree(&a);
+        SimDestroy();
+        return 1;
+    }
+
+    EquivPort *inputs = MatchPorts(a.inputs, b.inputs, "inputs");
+    EquivPort *outputs = inputs != NULL ? MatchPorts(a.outputs, b.outputs, "outputs") : NULL;
+    bool ok = inputs != NULL && outputs != NULL;
+    bool equivalent = false;
+
+    if(ok) {
+        size_t inputCount = a.inputs.count;
+        size_t outputCount = a.outputs.count;
+
+        // both circuits use the same variable for the inputs with the same name
+        SimChip **inputsA = GetMatchedChips(inputs, inputCount, false);
+        SimChip **inputsB = GetMatchedChips(inputs, inputCount, true);
+        SimChip **outputsA = GetMatchedChips(outputs, outputCount, false);
+        SimChip **outputsB = GetMatchedChips(outputs, outputCount, true);
+
+        BddNode *nodesA = malloc((outputCount > 0 ? outputCount : 1)*sizeof(BddNode));
+        BddNode *nodesB = malloc((outputCount > 0 ? outputCount : 1)*sizeof(BddNode));
+        uint8_t *assignment = malloc(inputCount > 0 ? inputCount : 1);
+        assert(nodesA != NULL && nodesB != NULL && assignment != NULL && "No enough ram");
+
+        BddManager *bdd = BddCreate(inputCount);
+        double start = GetSeconds();
+
+        ok = BddBuildCircuit(bdd, inputsA, inputCount, outputsA, outputCount, nodesA)
+            && BddBuildCircuit(bdd, inputsB, inputCount, outputsB, outputCount, nodesB);
+
+        equivalent = ok;
+
+        for(size_t i = 0; i < outputCount && ok; i++) {
+            // the BDDs are canonical
+            if(nodesA[i] == nodesB[i]) continue;
+
+            equivalent = false;
+
+            BddFindSat(bdd, BddXor(bdd, nodesA[i], nodesB[i]), assignment);
+            printf("The output %s differs, e.g. with:\n", a.outputs.items[i].name);
+
+            for(size_t j = 0; j < inputCount; j++) {
+                printf("  input  %s = %d\n", a.inputs.items[j].name, assignment[j]);
+            }
+        }
+
+        if(ok) {
+            printf("%s in %.3fs (%lu BDD nodes)\n", equivalent ? "The circuits are equivalent" : "The circuits are different",
+                GetSeconds() - start, BddGetNodeCount(bdd));
+        }
+
+        BddDestroy(bdd);
+        free(inputsA);
+        free(inputsB);
+        free(outputsA);
+        free(outputsB);
+        free(nodesA);
+        free(nodesB);
+        free(assignment);
+    }
+
+    free(inputs);
+    free(outputs);
+    ImportResultFree(&a);
+    ImportResultFree(&b);
+    SimDestroy();
+
+    return ok && equivalent ? 0 : 1;
+}
+
+static void PrintUsage(const char *program) {
+    printf("Usage: %s [--nand] [--no-thread] [--journal <file>] [command]\n", program);
+    printf("Without a command the editor is opened.\n");
+    printf("With --nand the netlists are imported with NANDs only.\n");
+    printf("With --no-thread the editor simulates inside the frame loop.\n");
+    printf("With --journal <file> the pins set in the editor are recorded.\n\n");
+    printf("Commands:\n");
+    printf("  import <netlist.blif|netlist.v>    imports a netlist and prints its stats\n");
+    printf("  faults <netlist> <vectors>         stuck-at fault coverage of the test vectors\n");
+    printf("  equiv <a> <b> [vectors]            compares two circuits with random vectors\n");
+    printf("  prove <a> <b>                      proves two circuits equivalent with BDDs\n");
+    printf("  truth <netlist>                    prints the truth table of every output\n");
+    printf("  replay <journal> [netlist]         replays a journal on the netlist (or the editor circuit)\n");
+    printf("  coverage <netlist> <vectors> [db]  toggle coverage of the vectors, merged into the db file\n");
+    printf("  activity <netlist> <vectors>       switching activity and power estimate of the vectors\n");
+    printf("  timing <netlist> [paths]           logic depth and critical paths, in gate levels\n");
+}
+
+// the circuit of the editor, "replay" builds it too when there's no netlist
+static void CreateEditorCircuit(SimChip **input, SimChip **led) {
     SimChip *s_nand_1 = SimNandCreate();
     SimChip *s_nand_2 = SimNandCreate();
 
     SimAddPinConnection(SimGetOutputPin(s_nand_1, 0), SimGetInputPin(s_nand_2, 0));
     SimAddPinConnection(SimGetOutputPin(s_nand_1, 0), SimGetInputPin(s_nand_2, 1));
 
-    SimChip *led = SimLedCreate();
-    SimAddPinConnection(SimGetOutputPin(s_nand_2, 0), SimGetInputPin(led, 0));
+    *led = SimLedCreate();
+    SimAddPinConnection(SimGetOutputPin(s_nand_2, 0), SimGetInputPin(*led, 0));
 
     SimSetInputPinState(s_nand_1, 0, SIM_PIN_ON);
     SimSetInputPinState(s_nand_1, 1, SIM_PIN_ON);
 
+    *input = s_nand_1;
+}
+
+static int ReplayCommand(const char *journalPath, const char *netlistPath) {
+    ImportResult result = {0};
+
+    if(netlistPath != NULL) {
+        if(!ImportNetlist(netlistPath, &result)) {
+            SimDestroy();
+            return 1;
+        }
+    } else {
+        SimChip *input, *led;
+        CreateEditorCircuit(&input, &led);
+    }
+
+    double start = GetSeconds();
+    JournalReplayStats stats;
+    bool ok = JournalReplay(journalPath, &stats);
+
+    if(ok) {
+        printf("Replayed %lu pin sets and %lu events in %.3fs\n", stats.records, stats.events, GetSeconds() - start);
+
+        for(size_t i = 0; i < result.outputs.count; i++) {
+            SimPin *pin = SimGetInputPin(result.outputs.items[i].chip, 0);
+            printf("  %s = %c\n", result.outputs.items[i].name, SimGetPinBit(pin, 0));
+        }
+    }
+
+    ImportResultFree(&result);
+    SimDestroy();
+
+    return ok ? 0 : 1;
+}
+
+// microseconds of the next frame that can be spent simulating
+static uint64_t GetFrameBudget(double drawSeconds) {
+    double budget = (1.0/TARGET_FPS - drawSeconds)*FRAME_BUDGET_SHARE;
+    if(budget < FRAME_MIN_BUDGET) budget = FRAME_MIN_BUDGET;
+
+    return budget*1e6;
+}
+
+int main(int argc, char **argv) {
+    bool useThread = true;
+    const char *journalPath = NULL;
+
+    // the options go before the command
+    while(argc > 1 && strncmp(argv[1], "--", 2) == 0) {
+        if(strcmp(argv[1], "--nand") == 0) {
+            ImportSetNandOnly(true);
+        } else if(strcmp(argv[1], "--no-thread") == 0) {
+            useThread = false;
+        } else if(strcmp(argv[1], "--journal") == 0 && argc > 2) {
+            journalPath = argv[2];
+            argv[2] = argv[0];
+            argv++;
+            argc--;
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+
+    if(argc > 1) {
+        if(strcmp(argv[1], "import") == 0 && argc == 3) {
+            return ImportCommand(argv[2]);
+        }
+
+        if(strcmp(argv[1], "faults") == 0 && argc == 4) {
+            return FaultsCommand(argv[2], argv[3]);
+        }
+
+        if(strcmp(argv[1], "equiv") == 0 && (argc == 4 || argc == 5)) {
+            uint64_t vectorCount = argc == 5 ? strtoull(argv[4], NULL, 10) : EQUIV_DEFAULT_VECTORS;
+            return EquivCommand(argv[2], argv[3], vectorCount);
+        }
+
+        if(strcmp(argv[1], "prove") == 0 && argc == 4) {
+            return ProveCommand(argv[2], argv[3]);
+        }
+
+        if(strcmp(argv[1], "truth") == 0 && argc == 3) {
+            return TruthCommand(argv[2]);
+        }
+
+        if(strcmp(argv[1], "replay") == 0 && (argc == 3 || argc == 4)) {
+            return ReplayCommand(argv[2], argc == 4 ? argv[3] : NULL);
+        }
+
+        if(strcmp(argv[1], "coverage") == 0 && (argc == 4 || argc == 5)) {
+            return CoverageCommand(argv[2], argv[3], argc == 5 ? argv[4] : NULL);
+        }
+
+        if(strcmp(argv[1], "activity") == 0 && argc == 4) {
+            return ActivityCommand(argv[2], argv[3]);
+        }
+
+        if(strcmp(argv[1], "timing") == 0 && (argc == 3 || argc == 4)) {
+            size_t maxPaths = argc == 4 ? strtoull(argv[3], NULL, 10) : TIMING_DEFAULT_PATHS;
+            return TimingCommand(argv[2], maxPaths);
+        }
+
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    InitWindow(1280, 720, "Logic Simulator");
+    SetTargetFPS(TARGET_FPS);
+
+    Nand *nand_1 = CreateNand(100, 100);
+    Nand *nand_2 = CreateNand(300, 100);
+    (void) nand_1;
+    (void) nand_2;
+
+    SimChip *s_nand_1, *led;
+    CreateEditorCircuit(&s_nand_1, &led);
+
     SimPrintChip(led);
 
+    if(journalPath != NULL && !JournalStart(journalPath)) {
+        CloseWindow();
+        return 1;
+    }
+
     VisualNandCreate((Vector2){500, 500});
 
+    // with the thread the window only talks to the simulation through it,
+    // otherwise the circuit advances a bit every frame
+    if(useThread) {
+        SimThreadStart(0);
+    } else {
+        SimSetAutoSettle(false);
+    }
+
+    bool nandInput = SIM_PIN_ON;
+    double drawSeconds = 0;
+
     while(!WindowShouldClose()) {
+        if(!useThread) SimRun(GetFrameBudget(drawSeconds), 0);
+        double drawStart = GetTime();
+
         BeginDrawing();
         ClearBackground(BLACK);
 
@@ -257,6 +845,25 @@ int main(void) {
             VisualNandCreate(mousePos);
         }
 
+        if(IsKeyPressed(KEY_T)) {
+            nandInput = !nandInput;
+
+            if(useThread) {
+                SimThreadSetInputPinState(s_nand_1, 0, nandInput);
+            } else {
+                SimSetInputPinState(s_nand_1, 0, nandInput);
+            }
+        }
+
+        bool ledOn;
+        if(useThread) {
+            const SimThreadSnapshot *snapshot = SimThreadGetSnapshot();
+            ledOn = SimThreadGetPinState(snapshot, SimGetInputPin(led, 0));
+        } else {
+            ledOn = SimGetPinState(SimGetInputPin(led, 0));
+        }
+        DrawText(ledOn ? "LED: ON" : "LED: OFF", 10, 10, 20, WHITE);
+
         VisualUpdate();
 
         for(size_t i = 0; i < state.wires.count; i++) {
@@ -302,9 +909,13 @@ int main(void) {
             da_append(&state.wireData.points, mousePos);
         }
 
+        // EndDrawing waits for the next frame, that time isn't counted
+        drawSeconds = GetTime() - drawStart;
         EndDrawing();
     }
 
+    SimThreadStop();
+    JournalStop();
     SimDestroy();
 
     CloseWindow();
@@ -0,0 +1,188 @@
+#include <string.h>
+
+#include "parallel.h"
+#include "CCFuncs.h"
+
+static bool IsSupported(SimChip *chip) {
+    switch(chip->type) {
+        case CHIP_NAND:
+        case CHIP_AND:
+        case CHIP_OR:
+        case CHIP_XOR:
+        case CHIP_NOT:
+        case CHIP_MUX:
+        case CHIP_FULL_ADDER:
+        case CHIP_LED:
+        case CHIP_INPUT:
+            break;
+        default:
+            return false;
+    }
+
+    if(chip->inputs.count > PARALLEL_MAX_PINS || chip->outputs.count > PARALLEL_MAX_PINS) return false;
+
+    for(size_t i = 0; i < chip->inputs.count; i++) {
+        if(chip->inputs.items[i].net != NULL || chip->inputs.items[i].width != 1) return false;
+    }
+
+    for(size_t i = 0; i < chip->outputs.count; i++) {
+        if(chip->outputs.items[i].net != NULL || chip->outputs.items[i].width != 1) return false;
+    }
+
+    return true;
+}
+
+static void CompileOps(ParallelNetlist *netlist) {
+    size_t opCount = 0;
+    size_t slotCount = 0;
+
+    for(size_t i = 0; i < netlist->count; i++) {
+        SimChip *chip = netlist->order[i];
+        if(chip->type == CHIP_INPUT || chip->outputs.count == 0) continue;
+
+        opCount++;
+        slotCount += chip->inputs.count + chip->outputs.count;
+    }
+
+    netlist->ops = malloc((opCount > 0 ? opCount : 1)*sizeof(ParallelOp));
+    netlist->slots = malloc((slotCount > 0 ? slotCount : 1)*sizeof(uint32_t));
+    assert(netlist->ops != NULL && netlist->slots != NULL && "No enough ram");
+
+    uint32_t next = 0;
+
+    for(size_t i = 0; i < netlist->count; i++) {
+        SimChip *chip = netlist->order[i];
+        if(chip->type == CHIP_INPUT || chip->outputs.count == 0) continue;
+
+        netlist->ops[netlist->opCount++] = (ParallelOp){
+            .chip = chip,
+            .first = next,
+            .type = chip->type,
+            .inputCount = chip->inputs.count,
+            .outputCount = chip->outputs.count,
+        };
+
+        for(size_t j = 0; j < chip->inputs.count; j++) {
+            SimPin *source = chip->inputs.items[j].source;
+            netlist->slots[next++] = source != NULL ? source->stateIndex : netlist->zeroSlot;
+        }
+
+        for(size_t j = 0; j < chip->outputs.count; j++) {
+            netlist->slots[next++] = chip->outputs.items[j].stateIndex;
+        }
+    }
+}
+
+bool ParallelNetlistCompile(ParallelNetlist *netlist) {
+    size_t count = SimGetChipCount();
+
+    *netlist = (ParallelNetlist){0};
+
+    for(size_t i = 0; i < count; i++) {
+        SimChip *chip = SimGetChip(i);
+
+        if(!IsSupported(chip)) {
+            log_error("The chip %s (#%u) can't be evaluated in parallel", SimGetChipTypeName(chip->type), chip->id);
+            return false;
+        }
+    }
+
+    netlist->order = malloc((count > 0 ? count : 1)*sizeof(SimChip*));
+    assert(netlist->order != NULL && "No enough ram");
+
+    netlist->count = SimSortTopologically(netlist->order);
+    netlist->zeroSlot = SimGetStateSlotCount();
+    netlist->slotCount = netlist->zeroSlot + 1;
+
+    if(netlist->count < count) {
+        log_error("The circuit has loops, it can't be evaluated in parallel");
+        ParallelNetlistFree(netlist);
+        return false;
+    }
+
+    CompileOps(netlist);
+
+    return true;
+}
+
+void ParallelNetlistFree(ParallelNetlist *netlist) {
+    free(netlist->order);
+    free(netlist->ops);
+    free(netlist->slots);
+    *netlist = (ParallelNetlist){0};
+}
+
+void ParallelSimInit(ParallelSim *sim, const ParallelNetlist *netlist) {
+    size_t slots = netlist->slotCount > 0 ? netlist->slotCount : 1;
+
+    *sim = (ParallelSim){0};
+    sim->netlist = netlist;
+    sim->values = calloc(slots, sizeof(uint64_t));
+    assert(sim->values != NULL && "No enough ram");
+}
+
+// an unconnected input is off
+static inline uint64_t ReadInput(ParallelSim *sim, SimPin *pin) {
+    return pin->source != NULL ? sim->values[pin->source->stateIndex] : 0;
+}
+
+void ParallelSimSetInput(ParallelSim *sim, SimChip *input, uint64_t lanes) {
+    assert(input->type == CHIP_INPUT);
+    sim->values[input->outputs.items[0].stateIndex] = lanes;
+}
+
+void ParallelEvalChip(SimChip *chip, const uint64_t *inputs, uint64_t *outputs) {
+    switch(chip->type) {
+        case CHIP_NAND: outputs[0] = ~(inputs[0] & inputs[1]); break;
+        case CHIP_AND: outputs[0] = inputs[0] & inputs[1]; break;
+        case CHIP_OR: outputs[0] = inputs[0] | inputs[1]; break;
+        case CHIP_XOR: outputs[0] = inputs[0] ^ inputs[1]; break;
+        case CHIP_NOT: outputs[0] = ~inputs[0]; break;
+        case CHIP_MUX: outputs[0] = (inputs[0] & ~inputs[2]) | (inputs[1] & inputs[2]); break;
+        case CHIP_FULL_ADDER: {
+            uint64_t halfSum = inputs[0] ^ inputs[1];
+            outputs[0] = halfSum ^ inputs[2];
+            outputs[1] = (inputs[0] & inputs[1]) | (halfSum & inputs[2]);
+        } break;
+        // the inputs are set from outside and the leds don't have outputs
+        default: break;
+    }
+}
+
+void ParallelSimEval(ParallelSim *sim) {
+    const ParallelNetlist *netlist = sim->netlist;
+    uint64_t *values = sim->values;
+    uint64_t inputs[PARALLEL_MAX_PINS];
+    uint64_t outputs[PARALLEL_MAX_PINS];
+
+    for(size_t i = 0; i < netlist->opCount; i++) {
+        ParallelOp op = netlist->ops[i];
+        const uint32_t *slots = &netlist->slots[op.first];
+
+        // the common case is inlined
+        if(op.type == CHIP_NAND) {
+            values[slots[2]] = ~(values[slots[0]] & values[slots[1]]);
+            continue;
+        }
+
+        for(size_t j = 0; j < op.inputCount; j++) {
+            inputs[j] = values[slots[j]];
+        }
+
+        ParallelEvalChip(op.chip, inputs, outputs);
+
+        for(size_t j = 0; j < op.outputCount; j++) {
+            values[slots[op.inputCount + j]] = outputs[j];
+        }
+    }
+}
+
+uint64_t ParallelSimGetOutput(ParallelSim *sim, SimChip *led) {
+    assert(led->type == CHIP_LED);
+    return ReadInput(sim, &led->inputs.items[0]);
+}
+
+void ParallelSimFree(ParallelSim *sim) {
+    free(sim->values);
+    *sim = (ParallelSim){0};
+}
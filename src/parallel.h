@@ -0,0 +1,63 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "simulation.h"
+
+// Evaluates the combinational circuit of the simulation on 64 independent
+// lanes at once: every pin has a word and bit N of the word is the value of
+// the pin in the copy N of the circuit. Every chip is evaluated once per
+// call in topological order, so there are no events or steps.
+//
+// The netlist is compiled once and can be shared (read only) by several
+// ParallelSim, e.g. one per thread. Only combinational single bit chips are
+// supported.
+
+// max number of inputs or outputs of the chips that can be evaluated
+#define PARALLEL_MAX_PINS 8
+
+// one chip of the compiled netlist, its inputs and outputs are the slots
+// "slots[first...]", inputs first
+typedef struct {
+    SimChip *chip;
+    uint32_t first;
+    // copied from the chip so the common case doesn't touch it
+    ChipType type;
+    uint8_t inputCount;
+    uint8_t outputCount;
+} ParallelOp;
+
+typedef struct {
+    SimChip **order; // every chip sorted topologically
+    size_t count;
+    size_t slotCount; // size of the arrays indexed by SimPin.stateIndex
+
+    // the chips with outputs in topological order, the inputs are read
+    // straight from the slot of their source or from "zeroSlot"
+    ParallelOp *ops;
+    size_t opCount;
+    uint32_t *slots;
+    uint32_t zeroSlot; // always 0, used by the unconnected inputs
+} ParallelNetlist;
+
+typedef struct {
+    const ParallelNetlist *netlist;
+    uint64_t *values; // indexed by SimPin.stateIndex
+} ParallelSim;
+
+// returns false and logs the error if the circuit has loops or chips that
+// can't be evaluated in parallel
+bool ParallelNetlistCompile(ParallelNetlist *netlist);
+void ParallelNetlistFree(ParallelNetlist *netlist);
+
+// computes the lanes of the outputs of a chip from the lanes of its inputs
+void ParallelEvalChip(SimChip *chip, const uint64_t *inputs, uint64_t *outputs);
+
+void ParallelSimInit(ParallelSim *sim, const ParallelNetlist *netlist);
+// sets the lanes of the output of a CHIP_INPUT
+void ParallelSimSetInput(ParallelSim *sim, SimChip *input, uint64_t lanes);
+void ParallelSimEval(ParallelSim *sim);
+// the lanes seen by the first input of a CHIP_LED
+uint64_t ParallelSimGetOutput(ParallelSim *sim, SimChip *led);
+void ParallelSimFree(ParallelSim *sim);
+
+#endif // PARALLEL_H
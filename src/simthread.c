@@ -0,0 +1,310 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "simthread.h"
+#include "CCFuncs.h"
+
+// time simulated at full speed between two looks at the queue
+#define SIM_THREAD_SLICE_US 1000
+// max steps simulated at once at a limited rate
+#define SIM_THREAD_BATCH_STEPS 64
+// min time between two snapshots while the circuit keeps changing
+#define SIM_THREAD_PUBLISH_NS 4000000
+// max sleep of the thread when it has nothing to do
+#define SIM_THREAD_IDLE_NS 500000
+
+// set in "middle" when the buffer has a snapshot the reader hasn't seen
+#define SIM_THREAD_FRESH 4u
+
+typedef enum {
+    SIM_COMMAND_SET_INPUT,
+    SIM_COMMAND_SET_OUTPUT,
+} SimCommandType;
+
+typedef struct {
+    SimCommandType type;
+    SimChip *chip;
+    size_t index;
+    uint64_t state;
+} SimCommand;
+
+typedef struct {
+    pthread_t thread;
+    bool running;
+    bool autoSettle; // restored when the thread stops
+
+    atomic_bool stop;
+    atomic_bool pauseRequested;
+    atomic_bool paused;
+    atomic_uint_fast64_t stepNs; // 0 at full speed
+
+    // the GUI pushes at "tail" and the thread pops at "head", both only grow
+    SimCommand commands[SIM_THREAD_QUEUE_SIZE];
+    atomic_size_t head;
+    atomic_size_t tail;
+
+    // triple buffer: the thread writes "back", the reader reads "front" and
+    // "middle" has the last published one. Publishing and reading swap their
+    // buffer with the middle one, so none of them waits for the other.
+    SimThreadSnapshot buffers[3];
+    atomic_uint middle;
+    unsigned back;
+    unsigned front;
+
+    // only used by the thread
+    uint64_t firstStep; // SimGetStepCount when the thread started
+    bool pending; // there may be events left
+} SimThreadState;
+
+static SimThreadState state = {0};
+
+static uint64_t GetNanoseconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec*1000000000 + time.tv_nsec;
+}
+
+static void SleepNanoseconds(uint64_t ns) {
+    struct timespec time = {
+        .tv_sec = ns / 1000000000,
+        .tv_nsec = ns % 1000000000,
+    };
+    nanosleep(&time, NULL);
+}
+
+static void Publish(void) {
+    SimThreadSnapshot *snapshot = &state.buffers[state.back];
+    size_t count = SimGetStateSlotCount();
+
+    if(snapshot->capacity < count || snapshot->states == NULL) {
+        snapshot->capacity = count > 0 ? count : 1;
+        snapshot->states = realloc(snapshot->states, snapshot->capacity*sizeof(uint64_t));
+        snapshot->unknown = realloc(snapshot->unknown, snapshot->capacity*sizeof(uint64_t));
+        assert(snapshot->states != NULL && snapshot->unknown != NULL && "No enough ram");
+    }
+
+    SimCopyPinStates(snapshot->states, snapshot->unknown);
+    snapshot->count = count;
+    snapshot->steps = SimGetStepCount() - state.firstStep;
+    snapshot->settled = !state.pending;
+
+    state.back = atomic_exchange(&state.middle, state.back | SIM_THREAD_FRESH) & ~SIM_THREAD_FRESH;
+}
+
+// returns true if there was any command
+static bool ApplyCommands(void) {
+    size_t head = atomic_load_explicit(&state.head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&state.tail, memory_order_acquire);
+
+    if(head == tail) return false;
+
+    for(; head != tail; head++) {
+        SimCommand command = state.commands[head % SIM_THREAD_QUEUE_SIZE];
+
+        switch(command.type) {
+            case SIM_COMMAND_SET_INPUT:
+                SimSetInputPinState(command.chip, command.index, command.state);
+                break;
+            case SIM_COMMAND_SET_OUTPUT:
+                SimSetOutputPinState(command.chip, command.index, command.state);
+                break;
+        }
+    }
+
+    atomic_store_explicit(&state.head, head, memory_order_release);
+    state.pending = true;
+
+    return true;
+}
+
+static void WaitWhilePaused(void) {
+    ApplyCommands();
+    atomic_store(&state.paused, true);
+
+    while(atomic_load(&state.pauseRequested) && !atomic_load(&state.stop)) {
+        SleepNanoseconds(SIM_THREAD_IDLE_NS);
+    }
+
+    // the circuit may have been edited
+    state.pending = true;
+    atomic_store(&state.paused, false);
+}
+
+// number of steps to simulate now, "lastStep" is when the last step was due
+static size_t GetDueSteps(uint64_t stepNs, uint64_t now, uint64_t *lastStep) {
+    uint64_t due = (now - *lastStep) / stepNs;
+
+    // a thread that falls behind doesn't try to catch up later
+    if(due > SIM_THREAD_BATCH_STEPS) {
+        *lastStep = now;
+        return SIM_THREAD_BATCH_STEPS;
+    }
+
+    *lastStep += due*stepNs;
+    return due;
+}
+
+static void *SimThreadMain(void *arg) {
+    (void)arg;
+
+    uint64_t lastPublish = GetNanoseconds();
+    uint64_t lastStep = lastPublish;
+    bool published = true;
+
+    while(!atomic_load(&state.stop)) {
+        if(atomic_load(&state.pauseRequested)) {
+            WaitWhilePaused();
+            published = false;
+            continue;
+        }
+
+        if(ApplyCommands()) published = false;
+
+        uint64_t stepNs = atomic_load(&state.stepNs);
+        uint64_t now = GetNanoseconds();
+        bool waiting = false; // for the next step at a limited rate
+
+        if(!state.pending) {
+            lastStep = now;
+        } else if(stepNs == 0) {
+            // a big step may take several slices
+            state.pending = !SimRun(SIM_THREAD_SLICE_US, 0);
+            published = false;
+        } else {
+            size_t steps = GetDueSteps(stepNs, now, &lastStep);
+            waiting = steps == 0;
+
+            for(size_t i = 0; i < steps && state.pending; i++) {
+                state.pending = SimStep();
+                published = false;
+            }
+        }
+
+        if(!published && (!state.pending || now - lastPublish >= SIM_THREAD_PUBLISH_NS)) {
+            Publish();
+            lastPublish = now;
+            published = true;
+        }
+
+        if(!state.pending) {
+            SleepNanoseconds(SIM_THREAD_IDLE_NS);
+        } else if(waiting) {
+            // the queue is still checked at least every SIM_THREAD_IDLE_NS
+            uint64_t wait = lastStep + stepNs - now;
+            SleepNanoseconds(wait < SIM_THREAD_IDLE_NS ? wait : SIM_THREAD_IDLE_NS);
+        }
+    }
+
+    // the edits pushed right before stopping aren't lost
+    ApplyCommands();
+
+    return NULL;
+}
+
+void SimThreadStart(double stepsPerSecond) {
+    assert(!state.running && "The thread is already running");
+
+    state.running = true;
+    state.autoSettle = SimGetAutoSettle();
+    SimSetAutoSettle(false);
+
+    atomic_store(&state.stop, false);
+    atomic_store(&state.pauseRequested, false);
+    atomic_store(&state.paused, false);
+    atomic_store(&state.head, 0);
+    atomic_store(&state.tail, 0);
+    SimThreadSetRate(stepsPerSecond);
+
+    state.front = 0;
+    atomic_store(&state.middle, 1);
+    state.back = 2;
+
+    state.firstStep = SimGetStepCount();
+    state.pending = true;
+
+    // the reader always has a snapshot
+    Publish();
+
+    int err = pthread_create(&state.thread, NULL, SimThreadMain, NULL);
+    assert(err == 0 && "Couldn't create the thread");
+}
+
+void SimThreadStop(void) {
+    if(!state.running) return;
+
+    atomic_store(&state.stop, true);
+    pthread_join(state.thread, NULL);
+
+    SimSetAutoSettle(state.autoSettle);
+
+    for(size_t i = 0; i < 3; i++) {
+        free(state.buffers[i].states);
+        free(state.buffers[i].unknown);
+        state.buffers[i] = (SimThreadSnapshot){0};
+    }
+
+    state.running = false;
+}
+
+bool SimThreadIsRunning(void) {
+    return state.running;
+}
+
+void SimThreadSetRate(double stepsPerSecond) {
+    uint64_t stepNs = 0;
+    if(stepsPerSecond > 0 && stepsPerSecond < 1e9) stepNs = 1e9 / stepsPerSecond;
+
+    atomic_store(&state.stepNs, stepNs);
+}
+
+void SimThreadPause(void) {
+    assert(state.running && "The thread isn't running");
+
+    atomic_store(&state.pauseRequested, true);
+    while(!atomic_load(&state.paused)) sched_yield();
+}
+
+void SimThreadResume(void) {
+    assert(state.running && "The thread isn't running");
+
+    atomic_store(&state.pauseRequested, false);
+    // otherwise a pause right after this could see the old acknowledgement
+    while(atomic_load(&state.paused)) sched_yield();
+}
+
+static void PushCommand(SimCommand command) {
+    assert(state.running && "The thread isn't running");
+
+    size_t tail = atomic_load_explicit(&state.tail, memory_order_relaxed);
+
+    while(tail - atomic_load_explicit(&state.head, memory_order_acquire) >= SIM_THREAD_QUEUE_SIZE) {
+        sched_yield();
+    }
+
+    state.commands[tail % SIM_THREAD_QUEUE_SIZE] = command;
+    atomic_store_explicit(&state.tail, tail + 1, memory_order_release);
+}
+
+void SimThreadSetInputPinState(SimChip *chip, size_t index, uint64_t pinState) {
+    PushCommand((SimCommand){SIM_COMMAND_SET_INPUT, chip, index, pinState});
+}
+
+void SimThreadSetOutputPinState(SimChip *chip, size_t index, uint64_t pinState) {
+    PushCommand((SimCommand){SIM_COMMAND_SET_OUTPUT, chip, index, pinState});
+}
+
+const SimThreadSnapshot *SimThreadGetSnapshot(void) {
+    assert(state.running && "The thread isn't running");
+
+    if(atomic_load(&state.middle) & SIM_THREAD_FRESH) {
+        state.front = atomic_exchange(&state.middle, state.front) & ~SIM_THREAD_FRESH;
+    }
+
+    return &state.buffers[state.front];
+}
+
+uint64_t SimThreadGetPinState(const SimThreadSnapshot *snapshot, SimPin *pin) {
+    return pin->stateIndex < snapshot->count ? snapshot->states[pin->stateIndex] : 0;
+}
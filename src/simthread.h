@@ -0,0 +1,55 @@
+#ifndef SIMTHREAD_H
+#define SIMTHREAD_H
+
+#include "simulation.h"
+
+// Runs the simulation on its own thread, at full speed or at a given number
+// of steps per second, so a slow circuit doesn't stall the window.
+//
+// The GUI never touches the simulation while the thread runs: the pin edits
+// go through a single producer single consumer queue and the pin states come
+// back through a triple buffered snapshot, neither of them takes a lock.
+// Anything else (creating chips, connecting pins, reading SimGetPinState...)
+// has to be done between SimThreadPause and SimThreadResume.
+
+// max number of edits waiting for the thread, pushing more waits for room
+#define SIM_THREAD_QUEUE_SIZE 1024
+
+// the pin states published by the thread, indexed by SimPin.stateIndex (the
+// pulled pins are resolved by the thread, see SimCopyPinStates)
+typedef struct {
+    uint64_t *states;
+    uint64_t *unknown; // all zeros in two state mode
+    size_t count;
+    size_t capacity;
+
+    uint64_t steps; // steps simulated since the thread started
+    bool settled;
+} SimThreadSnapshot;
+
+// 0 steps per second runs at full speed
+void SimThreadStart(double stepsPerSecond);
+// the circuit is left as the thread left it, it may not be settled
+void SimThreadStop(void);
+bool SimThreadIsRunning(void);
+void SimThreadSetRate(double stepsPerSecond);
+
+// Waits until the thread has applied the queued edits and stopped between two
+// steps. While paused the simulation can be used as if there was no thread,
+// except that the edits don't settle the circuit: the thread does it after
+// SimThreadResume.
+void SimThreadPause(void);
+void SimThreadResume(void);
+
+// Queue an edit for the thread, they're applied in order. Only one thread can
+// push edits.
+void SimThreadSetInputPinState(SimChip *chip, size_t index, uint64_t state);
+void SimThreadSetOutputPinState(SimChip *chip, size_t index, uint64_t state);
+
+// The last snapshot published by the thread, it stays valid until the next
+// call. Only one thread can read the snapshots.
+const SimThreadSnapshot *SimThreadGetSnapshot(void);
+// pins created after the snapshot was published read as off
+uint64_t SimThreadGetPinState(const SimThreadSnapshot *snapshot, SimPin *pin);
+
+#endif // SIMTHREAD_H
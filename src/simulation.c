@@ -1,41 +1,493 @@
 #include <string.h>
+#include <time.h>
 
 #include "simulation.h"
 #include "CCFuncs.h"
 
+// the levelized engine patches the levels after every edit, once the number
+// of chips patched since the last full levelization passes this (or 1/8 of
+// the chips on big circuits) the levels are recomputed from scratch
+#define SIM_RELEVELIZE_MIN_PATCHES 1024
+
+// chips, pins and fan-out arrays are allocated from an arena with regions of
+// this size, destroying the simulation frees them all at once
+#define SIM_ARENA_REGION_SIZE (1024*1024)
+// pin arrays with up to this many pins are recycled by their exact size when
+// their chip is destroyed, the bigger ones by size class
+#define SIM_MAX_RECYCLED_PINS 8
+// fan-out and big pin arrays are recycled by size class, class N holds arrays
+// with room for at least 2^N pins
+#define SIM_SIZE_CLASSES 40
+
+// smaller steps are evaluated in the order of their events
+#define SIM_GROUP_MIN_EVENTS 64
+// SimRun looks at the clock after evaluating this many events
+#define SIM_RUN_CHECK_EVENTS 256
+// a new checkpoint is taken when the log reaches 1/SIM_HISTORY_LOG_FRACTION of
+// the size of a snapshot, it bounds the time to replay a log
+#define SIM_HISTORY_LOG_FRACTION 4
+
+typedef struct SimFreeBlock SimFreeBlock;
+
+// memory given back to the simulation is kept in free lists, the link is
+// stored in the memory itself
+struct SimFreeBlock {
+    SimFreeBlock *next;
+};
+
+typedef struct {
+    SimPin **items;
+    size_t count;
+    size_t capacity;
+} SimEventQueue;
+
+typedef struct {
+    SimPin *pin;
+    uint64_t state;
+    uint64_t unknown;
+} SimPinUpdate;
+
+typedef struct {
+    SimPinUpdate *items;
+    size_t count;
+    size_t capacity;
+} SimUpdateQueue;
+
+// a four state word, the unknown bits have value 1 for X and 0 for Z
+typedef struct {
+    uint64_t value;
+    uint64_t unknown;
+} SimPlanes;
+
+typedef struct {
+    SimChip *chip;
+    uint32_t level;
+} SimLevelPatch;
+
+typedef struct {
+    SimPin *outPin;
+    SimPin *inPin;
+} SimConnection;
+
+typedef struct {
+    uint32_t id;
+    SimPin *pin;
+    SimWatchKind kind;
+    uint64_t mask;
+    uint64_t value;
+} SimWatch;
+
+typedef enum {
+    SIM_LOG_PIN, // SetPinState, replaying it propagates the value again
+    SIM_LOG_NET, // value given to a net by ResolveNet
+    SIM_LOG_SLOT, // internal state of a chip
+    SIM_LOG_STEP, // "value" is the step and "unknown" the level it takes
+} SimLogKind;
+
+// only the writes that start a propagation are logged, so the log doesn't
+// grow with the fan-out
+typedef struct {
+    void *target; // SimPin or SimNet
+    uint64_t value;
+    uint64_t unknown;
+    uint32_t slot;
+    uint8_t kind;
+} SimLogEntry;
+
+// level of the steps of the event driven engine, they take every event
+#define SIM_LOG_ALL_LEVELS UINT64_MAX
+
+// full copy of the state taken when "step" was about to start, followed by
+// the log of every write made after it
+typedef struct {
+    uint64_t step;
+    SimStateSnapshot *snapshot;
+    size_t snapshotBytes;
+
+    struct {
+        SimLogEntry *items;
+        size_t count;
+        size_t capacity;
+    } log;
+} SimCheckpoint;
+
 typedef struct {
+    Arena *arena;
+    SimFreeBlock *freeChips;
+    SimFreeBlock *freePinArrs[SIM_MAX_RECYCLED_PINS + 1]; // indexed by number of pins
+    SimFreeBlock *freeBigPinArrs[SIM_SIZE_CLASSES];
+    SimFreeBlock *freeTargets[SIM_SIZE_CLASSES];
+
+    // chips are allocated one by one so the pointers given to the user
+    // (and the parentChip of the pins) stay valid when the array grows
     struct {
-        SimChip *items;
+        SimChip **items;
         size_t count;
         size_t capacity;
     } chips;
+
+    struct {
+        SimNet **items;
+        size_t count;
+        size_t capacity;
+    } nets;
+    // nets whose drivers changed, they're resolved at the end of the step
+    struct {
+        SimNet **items;
+        size_t count;
+        size_t capacity;
+    } dirtyNets;
+
+    // input pins whose change scheduled their chip for the next step,
+    // a chip is only added once thanks to SimChip.scheduled
+    SimEventQueue events;
+    SimEventQueue processing;
+    SimEventQueue grouped; // scratch queue of GroupEventsByType
+
+    // outputs computed during a step, they're applied once every chip of the
+    // step was evaluated so the order of evaluation doesn't matter
+    SimUpdateQueue updates;
+    // outputs of the sequential chips. The levelized engine applies the
+    // updates after every chip, these wait until the end of the level so a
+    // flip-flop never sees the new output of another one clocked by the
+    // same edge
+    SimUpdateQueue clockedUpdates;
+
+    bool building;
+    struct {
+        SimConnection *items;
+        size_t count;
+        size_t capacity;
+    } buildConnections;
+
+    // the state of every pin lives in this array (indexed by SimPin.stateIndex)
+    // so the whole state can be saved and restored with a single memcpy.
+    // Every pin takes a whole word, so buses don't need a separate storage
+    struct {
+        uint64_t *items;
+        size_t count;
+        size_t capacity;
+    } pinStates;
+    // second bit-plane of the four state mode, same indices as pinStates.
+    // Only allocated while the mode is enabled
+    bool fourState;
+    struct {
+        uint64_t *items;
+        size_t count;
+        size_t capacity;
+    } pinUnknown;
+    // slots of pinStates released by destroyed chips
+    struct {
+        uint32_t *items;
+        size_t count;
+        size_t capacity;
+    } freePinStates;
+
+    // incremented on every change to the netlist, used to reject snapshots
+    // taken from another circuit
+    uint64_t netlistVersion;
+
+    // targets of a pulling driver that were set from outside, they read
+    // their own slot until the driver changes again
+    struct {
+        SimPin **items;
+        size_t count;
+        size_t capacity;
+    } forcedPins;
+
+    SimEngine engine;
+    // set by SimSetAutoSettle(false), the edits only schedule their events
+    bool manualSettle;
+
+    // SimRun can leave a step halfway, "stepCursor" events of the step
+    // (state.processing or the bucket of "stepLevel") were already evaluated
+    bool stepping;
+    bool steppingLevel;
+    size_t stepLevel;
+    size_t stepCursor;
+    uint64_t stepCount; // complete steps
+    uint64_t eventCount; // chips evaluated by the steps and the cycles
+
+    SimStimulusHook stimulusHook;
+    SimCycleHook cycleHook;
+
+    // reverse debugging, see SimHistoryEnable. There's always a checkpoint
+    // while it's enabled, the writes go to the log of the last one
+    struct {
+        bool enabled;
+        size_t maxBytes;
+        size_t interval;
+        size_t usedBytes;
+
+        // the history is only valid while these don't change
+        uint64_t netlistVersion;
+        SimEngine engine;
+        bool fourState;
+        uint64_t coneVersion;
+
+        struct {
+            SimCheckpoint *items;
+            size_t count;
+            size_t capacity;
+        } checkpoints;
+    } history;
+
+    // bit N of "slots" is set while the slot N has a watch, the pins
+    // without watches only pay a bounds check when they change
+    struct {
+        uint32_t nextId;
+        bool stopped;
+
+        struct {
+            SimWatch *items;
+            size_t count;
+            size_t capacity;
+        } watches;
+
+        struct {
+            uint64_t *items;
+            size_t count;
+            size_t capacity;
+        } slots;
+
+        struct {
+            SimWatchHit *items;
+            size_t count;
+            size_t capacity;
+        } hits;
+    } watch;
+
+    // demand driven mode, see SimDemandEnable. The chips in the cone have
+    // SimChip.observed set, it's computed again once the netlist version
+    // changes or "dirty" is set by the probes and the watches
+    struct {
+        bool enabled;
+        bool dirty;
+        uint64_t netlistVersion;
+        uint64_t coneVersion; // incremented every time the cone is computed
+        size_t coneSize;
+
+        struct {
+            SimPin **items;
+            size_t count;
+            size_t capacity;
+        } probes;
+
+        struct {
+            SimChip **items;
+            size_t count;
+            size_t capacity;
+        } stack;
+    } demand;
+
+    // toggle coverage, indexed by slot like the watches
+    struct {
+        bool enabled;
+
+        struct {
+            uint64_t *items;
+            size_t count;
+            size_t capacity;
+        } rise;
+
+        struct {
+            uint64_t *items;
+            size_t count;
+            size_t capacity;
+        } fall;
+    } coverage;
+
+    // bit transitions of the output pins, indexed by slot
+    struct {
+        bool enabled;
+
+        struct {
+            uint64_t *items;
+            size_t count;
+            size_t capacity;
+        } toggles;
+    } activity;
+
+    // cycle based simulation, see SimRunCycles. The plan is made again once
+    // the netlist version changes
+    struct {
+        bool running;
+        bool planned;
+        uint64_t netlistVersion;
+        SimPin *clock; // NULL without flip-flops
+
+        // the evaluated chips except the flip-flops, in topological order
+        struct {
+            SimChip **items;
+            size_t count;
+            size_t capacity;
+        } order;
+
+        struct {
+            SimChip **items;
+            size_t count;
+            size_t capacity;
+        } flipFlops;
+    } cycle;
+
+    // levelized engine: the scheduled chips wait in the bucket of their level
+    // and the buckets are evaluated from the lowest level to the highest
+    struct {
+        SimEventQueue *items;
+        size_t count;
+        size_t capacity;
+    } levelBuckets;
+    size_t nextLevel; // lowest level that may have events
+    size_t levelEvents; // number of events in all the buckets
+    size_t levelPatches; // chips raised incrementally since the last full levelization
+    struct {
+        SimLevelPatch *items;
+        size_t count;
+        size_t capacity;
+    } levelStack;
 } SimState;
 
+struct SimStateSnapshot {
+    uint64_t netlistVersion;
+    uint64_t coneVersion; // 0 if the demand driven mode was disabled
+
+    size_t eventCount;
+    SimPin **events;
+
+    size_t forcedCount;
+    SimPin **forcedPins;
+
+    size_t pinCount;
+    uint64_t *pinStates;
+    uint64_t *pinUnknown; // NULL if the snapshot was taken in two state mode
+};
+
 static SimState state = {0};
 
-static uint16_t GenerateId() {
-    static uint16_t id = 1;
+static uint32_t GenerateId() {
+    static uint32_t id = 1;
     return id++;
 }
 
+static void *ArenaAlloc(size_t size) {
+    if(state.arena == NULL) {
+        state.arena = arena_create(SIM_ARENA_REGION_SIZE);
+    }
+
+    return arena_alloc(state.arena, size);
+}
+
+static void *PopFreeBlock(SimFreeBlock **list) {
+    SimFreeBlock *block = *list;
+    if(block != NULL) *list = block->next;
+    return block;
+}
+
+static void PushFreeBlock(SimFreeBlock **list, void *mem) {
+    SimFreeBlock *block = mem;
+    block->next = *list;
+    *list = block;
+}
+
+static SimChip *AllocChip(ChipType type) {
+    SimChip *chip = PopFreeBlock(&state.freeChips);
+    if(chip == NULL) chip = ArenaAlloc(sizeof(SimChip));
+
+    bzero(chip, sizeof(SimChip));
+
+    chip->id = GenerateId();
+    chip->type = type;
+    chip->index = state.chips.count;
+
+    da_append(&state.chips, chip);
+    state.netlistVersion++;
+
+    return chip;
+}
+
+// makes room for the slot in the coverage bitmaps and forgets its toggles
+static void ResetSlotCoverage(uint32_t slot) {
+    while(state.coverage.rise.count <= slot/64) {
+        da_append(&state.coverage.rise, 0);
+        da_append(&state.coverage.fall, 0);
+    }
+
+    uint64_t bit = (uint64_t)1 << (slot % 64);
+    state.coverage.rise.items[slot/64] &= ~bit;
+    state.coverage.fall.items[slot/64] &= ~bit;
+}
+
+static void ResetSlotActivity(uint32_t slot) {
+    while(state.activity.toggles.count <= slot) {
+        da_append(&state.activity.toggles, 0);
+    }
+
+    state.activity.toggles.items[slot] = 0;
+}
+
+static uint32_t AllocStateSlot(void) {
+    uint32_t index;
+
+    if(state.freePinStates.count > 0) {
+        index = state.freePinStates.items[--state.freePinStates.count];
+        state.pinStates.items[index] = SIM_PIN_OFF;
+        if(state.fourState) state.pinUnknown.items[index] = 0;
+    } else {
+        index = state.pinStates.count;
+        da_append(&state.pinStates, SIM_PIN_OFF);
+        if(state.fourState) da_append(&state.pinUnknown, 0);
+    }
+
+    if(state.coverage.enabled) ResetSlotCoverage(index);
+    if(state.activity.enabled) ResetSlotActivity(index);
+
+    return index;
+}
+
+// smallest class whose arrays can hold "capacity" pins
+static size_t GetSizeClass(size_t capacity) {
+    size_t class = 0;
+    while(((size_t)1 << class) < capacity) class++;
+
+    assert(class < SIM_SIZE_CLASSES);
+    return class;
+}
+
 static SimPinArr AllocPinArr(size_t count) {
+    if(count == 0) return (SimPinArr){0};
+
     size_t size = count * sizeof(SimPin);
 
-    SimPin *items = malloc(size);
+    SimPin *items = NULL;
+    if(count <= SIM_MAX_RECYCLED_PINS) {
+        items = PopFreeBlock(&state.freePinArrs[count]);
+        if(items == NULL) items = ArenaAlloc(size);
+    } else {
+        // the whole class is allocated, so any array of the class can be reused
+        size_t class = GetSizeClass(count);
+        items = PopFreeBlock(&state.freeBigPinArrs[class]);
+        if(items == NULL) items = ArenaAlloc(((size_t)1 << class)*sizeof(SimPin));
+    }
+
     bzero(items, size);
 
+    for(size_t i = 0; i < count; i++) {
+        items[i].width = 1;
+        items[i].stateIndex = AllocStateSlot();
+        items[i].readIndex = items[i].stateIndex;
+    }
+
     return (SimPinArr) {
         .items = items,
         .count = count
     };
 }
 
-static SimPinArr CreateInputPinArr(size_t count, SimPinOnChange onChange, SimChip *parentChip) {
+static SimPinArr CreateInputPinArr(size_t count, SimChip *parentChip) {
     SimPinArr arr = AllocPinArr(count);
 
     for(size_t i = 0; i < count; i++) {
         arr.items[i].isInput = true;
-        arr.items[i].onChange = onChange;
         arr.items[i].parentChip = parentChip;
     }
 
@@ -52,119 +504,2821 @@ static SimPinArr CreateOutputPinArr(size_t count, SimChip *parentChip) {
     return arr;
 }
 
-static uint8_t GetInputState(SimChip *chip, size_t index) {
-    assert(index < chip->inputs.count);
-    return chip->inputs.items[index].state;
+static inline bool IsSlotWatched(uint32_t slot) {
+    return slot/64 < state.watch.slots.count && (state.watch.slots.items[slot/64] >> (slot % 64)) & 1;
 }
 
-static void NandOnChange(SimChip *nand) {
-    uint8_t state = !(GetInputState(nand, 0) && GetInputState(nand, 1));
-    SimSetOutputPinState(nand, 0, state);
+static void RemoveWatch(size_t index) {
+    SimPin *pin = state.watch.watches.items[index].pin;
+    state.watch.watches.items[index] = state.watch.watches.items[--state.watch.watches.count];
+
+    // the pulled pins share the bit of their driver
+    for(size_t i = 0; i < state.watch.watches.count; i++) {
+        if(state.watch.watches.items[i].pin->readIndex == pin->readIndex) return;
+    }
+
+    state.watch.slots.items[pin->readIndex/64] &= ~((uint64_t)1 << (pin->readIndex % 64));
+    state.demand.dirty = true;
 }
 
-SimChip *SimNandCreate(void) {
-    da_append(&state.chips, ((SimChip){0}));
-    SimChip *nand = &state.chips.items[state.chips.count - 1];
+static void SetWatchSlot(uint32_t slot) {
+    while(state.watch.slots.count <= slot/64) {
+        da_append(&state.watch.slots, 0);
+    }
 
-    nand->id = GenerateId();
-    nand->type = CHIP_NAND;
-    nand->inputs = CreateInputPinArr(2, &NandOnChange, nand);
-    nand->outputs = CreateOutputPinArr(1, nand);
+    state.watch.slots.items[slot/64] |= (uint64_t)1 << (slot % 64);
+}
 
-    SimSetOutputPinState(nand, 0, SIM_PIN_ON);
+// after a pin changed the slot it's read from
+static void RebuildWatchSlots(void) {
+    if(state.watch.slots.count > 0) bzero(state.watch.slots.items, state.watch.slots.count*sizeof(uint64_t));
 
-    return nand;
+    for(size_t i = 0; i < state.watch.watches.count; i++) {
+        SetWatchSlot(state.watch.watches.items[i].pin->readIndex);
+    }
 }
 
-SimChip *SimLedCreate(void) {
-    da_append(&state.chips, ((SimChip){0}));
-    SimChip *led = &state.chips.items[state.chips.count - 1];
+static void RemovePinWatches(SimPin *pin) {
+    for(size_t i = state.watch.watches.count; i-- > 0;) {
+        if(state.watch.watches.items[i].pin == pin) RemoveWatch(i);
+    }
+}
 
-    led->id = GenerateId();
-    led->type = CHIP_LED;
-    led->inputs = CreateInputPinArr(1, NULL, led);
+static void RemoveProbe(size_t index) {
+    state.demand.probes.items[index] = state.demand.probes.items[--state.demand.probes.count];
+    state.demand.dirty = true;
+}
 
-    return led;
+static void RemovePinProbes(SimPin *pin) {
+    for(size_t i = state.demand.probes.count; i-- > 0;) {
+        if(state.demand.probes.items[i] == pin) RemoveProbe(i);
+    }
 }
 
-static void SetPinState(SimPin *pin, uint8_t state) {
-    pin->state = state;
+static void FreePinArr(SimPinArr arr) {
+    for(size_t i = 0; i < arr.count; i++) {
+        if(IsSlotWatched(arr.items[i].readIndex)) RemovePinWatches(&arr.items[i]);
+        if(state.demand.probes.count > 0) RemovePinProbes(&arr.items[i]);
+        da_append(&state.freePinStates, arr.items[i].stateIndex);
+    }
 
-    if(pin->isInput) {
-        if(pin->onChange != NULL) {
-            assert(pin->parentChip != NULL);
-            pin->onChange(pin->parentChip);
-        }
+    if(arr.count > 0 && arr.count <= SIM_MAX_RECYCLED_PINS) {
+        PushFreeBlock(&state.freePinArrs[arr.count], arr.items);
+    } else if(arr.count > 0) {
+        PushFreeBlock(&state.freeBigPinArrs[GetSizeClass(arr.count)], arr.items);
+    }
+}
+
+static void ReleaseTargets(SimPin *outPin) {
+    size_t capacity = outPin->connectedTargets.capacity;
+    if(capacity == 0) return;
+
+    // biggest class the array fits in
+    size_t class = GetSizeClass(capacity);
+    if(((size_t)1 << class) > capacity) class--;
+
+    PushFreeBlock(&state.freeTargets[class], outPin->connectedTargets.items);
+
+    outPin->connectedTargets.items = NULL;
+    outPin->connectedTargets.count = 0;
+    outPin->connectedTargets.capacity = 0;
+}
+
+static void ResizeTargets(SimPin *outPin, size_t capacity) {
+    assert(capacity >= outPin->connectedTargets.count);
+
+    SimPin **items = PopFreeBlock(&state.freeTargets[GetSizeClass(capacity)]);
+    if(items == NULL) items = ArenaAlloc(capacity*sizeof(SimPin*));
+
+    size_t count = outPin->connectedTargets.count;
+    if(count > 0) memcpy(items, outPin->connectedTargets.items, count*sizeof(SimPin*));
+
+    ReleaseTargets(outPin);
+
+    outPin->connectedTargets.items = items;
+    outPin->connectedTargets.count = count;
+    outPin->connectedTargets.capacity = capacity;
+}
+
+static inline uint64_t GetPinState(SimPin *pin) {
+    return state.pinStates.items[pin->readIndex];
+}
+
+static uint64_t GetInputState(SimChip *chip, size_t index) {
+    assert(index < chip->inputs.count);
+    return GetPinState(&chip->inputs.items[index]);
+}
+
+static inline uint64_t GetPinUnknown(SimPin *pin) {
+    return state.fourState ? state.pinUnknown.items[pin->readIndex] : 0;
+}
+
+static inline void LogWrite(SimLogKind kind, void *target, uint32_t slot, uint64_t value, uint64_t unknown) {
+    if(!state.history.enabled) return;
+
+    SimCheckpoint *last = &state.history.checkpoints.items[state.history.checkpoints.count - 1];
+    da_append(&last->log, ((SimLogEntry){target, value, unknown, slot, kind}));
+    state.history.usedBytes += sizeof(SimLogEntry);
+}
+
+static inline bool IsWatchMatching(SimWatch *watch, uint64_t value, uint64_t unknown) {
+    return (unknown & watch->mask) == 0 && (value & watch->mask) == watch->value;
+}
+
+// called before the slot takes its new state, it checks the watches of the
+// pin written and of the pins pulling from it
+static void CheckWatches(uint32_t slot, uint64_t value, uint64_t unknown) {
+    uint64_t prevValue = state.pinStates.items[slot];
+    uint64_t prevUnknown = 0;
+
+    if(state.fourState) {
+        prevUnknown = state.pinUnknown.items[slot];
     } else {
-        for(size_t i = 0; i < pin->connectedTargets.count; i++) {
-            SetPinState(pin->connectedTargets.items[i], state);
+        unknown = 0;
+    }
+
+    for(size_t i = 0; i < state.watch.watches.count; i++) {
+        SimWatch *watch = &state.watch.watches.items[i];
+        if(watch->pin->readIndex != slot) continue;
+
+        bool triggered;
+        if(watch->kind == SIM_WATCH_CHANGE) {
+            triggered = ((prevValue ^ value) | (prevUnknown ^ unknown)) & watch->mask;
+        } else {
+            triggered = IsWatchMatching(watch, value, unknown) && !IsWatchMatching(watch, prevValue, prevUnknown);
         }
+
+        if(!triggered) continue;
+
+        SimWatchHit hit = {watch->id, watch->pin, state.stepCount, state.eventCount, value, unknown};
+        da_append(&state.watch.hits, hit);
+        state.watch.stopped = true;
     }
 }
 
-void SimSetInputPinState(SimChip *chip, size_t index, uint8_t state) {
-    assert(index < chip->inputs.count);
+// called before the pin takes its new state
+static inline void RecordToggles(uint32_t slot, uint64_t value, uint64_t unknown) {
+    uint64_t prev = state.pinStates.items[slot];
+    uint64_t known = state.fourState ? ~(state.pinUnknown.items[slot] | unknown) : ~(uint64_t)0;
+    uint64_t bit = (uint64_t)1 << (slot % 64);
 
-    SetPinState(&chip->inputs.items[index], state);
+    if(~prev & value & known) state.coverage.rise.items[slot/64] |= bit;
+    if(prev & ~value & known) state.coverage.fall.items[slot/64] |= bit;
 }
 
-void SimSetOutputPinState(SimChip *chip, size_t index, uint8_t state) {
-    assert(index < chip->outputs.count);
+// called before the output pin takes its new state
+static inline void CountToggles(uint32_t slot, uint64_t value, uint64_t unknown) {
+    uint64_t changed = state.pinStates.items[slot] ^ value;
+    if(state.fourState) changed |= state.pinUnknown.items[slot] ^ unknown;
 
-    SetPinState(&chip->outputs.items[index], state);
+    state.activity.toggles.items[slot] += __builtin_popcountll(changed);
 }
 
-SimPin *SimGetInputPin(SimChip *chip, size_t index) {
+static inline uint64_t GetWidthMask(uint8_t width) {
+    return width >= 64 ? UINT64_MAX : ((uint64_t)1 << width) - 1;
+}
+
+// the chips read Z as X, so every unknown bit of the result has value 1
+static SimPlanes GetInputPlanes(SimChip *chip, size_t index) {
     assert(index < chip->inputs.count);
-    return &chip->inputs.items[index];
+
+    SimPin *pin = &chip->inputs.items[index];
+    uint64_t unknown = state.pinUnknown.items[pin->readIndex];
+
+    return (SimPlanes){GetPinState(pin) | unknown, unknown};
 }
-SimPin *SimGetOutputPin(SimChip *chip, size_t index) {
+
+static inline bool IsSequential(SimChip *chip) {
+    return chip->type == CHIP_DFF || chip->type == CHIP_LATCH;
+}
+
+// used by the chips to set their outputs, the new state is applied at the end of the step
+static void DrivePlanes(SimChip *chip, size_t index, uint64_t value, uint64_t unknown) {
     assert(index < chip->outputs.count);
-    return &chip->outputs.items[index];
+
+    SimPinUpdate update = {
+        .pin = &chip->outputs.items[index],
+        .state = value,
+        .unknown = unknown,
+    };
+    da_append(IsSequential(chip) ? &state.clockedUpdates : &state.updates, update);
 }
 
-void SimAddPinConnection(SimPin *outPin, SimPin *inPin) {
-    assert(!outPin->isInput && inPin->isInput);
+static void DriveOutput(SimChip *chip, size_t index, uint64_t pinState) {
+    DrivePlanes(chip, index, pinState, 0);
+}
+
+// Four state operations. They work bit by bit without branches, so they're
+// also valid on 64 independent lanes. The inputs come from GetInputPlanes,
+// a bit is a known 0 when its value is 0 and a known 1 when its value is 1
+// and it isn't unknown.
+static inline SimPlanes AndPlanes(SimPlanes a, SimPlanes b) {
+    uint64_t value = a.value & b.value;
+    return (SimPlanes){value, value & (a.unknown | b.unknown)};
+}
+
+static inline SimPlanes OrPlanes(SimPlanes a, SimPlanes b) {
+    uint64_t value = a.value | b.value;
+    uint64_t one = (a.value & ~a.unknown) | (b.value & ~b.unknown);
+    return (SimPlanes){value, value & ~one};
+}
+
+static inline SimPlanes XorPlanes(SimPlanes a, SimPlanes b) {
+    uint64_t unknown = a.unknown | b.unknown;
+    return (SimPlanes){(a.value ^ b.value) | unknown, unknown};
+}
+
+static inline SimPlanes NotPlanes(SimPlanes a) {
+    return (SimPlanes){~a.value | a.unknown, a.unknown};
+}
 
-    if(outPin->connectedTargets.capacity == 0) {
-        // initialize array with a capacity of 1
-        da_init(&outPin->connectedTargets, 1);
+static void NandOnChange(SimChip *nand) {
+    if(state.fourState) {
+        SimPlanes out = NotPlanes(AndPlanes(GetInputPlanes(nand, 0), GetInputPlanes(nand, 1)));
+        DrivePlanes(nand, 0, out.value & 1, out.unknown & 1);
+        return;
     }
 
-    da_append(&outPin->connectedTargets, inPin);
+    uint8_t state = !(GetInputState(nand, 0) && GetInputState(nand, 1));
+    DriveOutput(nand, 0, state);
+}
+
+SimChip *SimNandCreate(void) {
+    SimChip *nand = AllocChip(CHIP_NAND);
+
+    nand->inputs = CreateInputPinArr(2, nand);
+    nand->outputs = CreateOutputPinArr(1, nand);
+
+    // both inputs start off, so the output is already settled
+    state.pinStates.items[nand->outputs.items[0].stateIndex] = SIM_PIN_ON;
+
+    return nand;
+}
+
+SimChip *SimLedCreate(void) {
+    SimChip *led = AllocChip(CHIP_LED);
 
-    SetPinState(inPin, outPin->state);
+    led->inputs = CreateInputPinArr(1, led);
+
+    return led;
 }
 
-void SimPrintChip(SimChip *chip) {
-    const char *chipName = chip->type == CHIP_NAND ? "NAND" : "LED";
+SimChip *SimInputCreate(void) {
+    return SimBusInputCreate(1);
+}
 
-    printf("[%s] (#%d) {\n", chipName, chip->id);
+static void DriveMaskedPlanes(SimChip *chip, size_t index, SimPlanes planes) {
+    uint64_t mask = GetWidthMask(chip->outputs.items[index].width);
+    DrivePlanes(chip, index, planes.value & mask, planes.unknown & mask);
+}
 
-    printf("  [Inputs] {\n");
-    for(size_t i = 0; i < chip->inputs.count; i++) {
-        printf("    [%lu] = %d\n", i, chip->inputs.items[i].state);
+static void SetPinArrWidth(SimPinArr arr, uint8_t width) {
+    for(size_t i = 0; i < arr.count; i++) {
+        arr.items[i].width = width;
     }
-    printf("  }\n");
+}
 
-    printf("  [Ouputs] {\n");
-    for(size_t i = 0; i < chip->outputs.count; i++) {
-        printf("    [%lu] = %d\n", i, chip->outputs.items[i].state);
+// all the pins start with the given width, every input and output of a bus
+// chip starts at 0 so they're created already settled
+static SimChip *CreateBusChip(ChipType type, uint8_t width, size_t inputs, size_t outputs) {
+    assert(width > 0 && width <= SIM_MAX_BUS_WIDTH && "Invalid bus width");
+
+    SimChip *chip = AllocChip(type);
+
+    chip->inputs = CreateInputPinArr(inputs, chip);
+    chip->outputs = CreateOutputPinArr(outputs, chip);
+
+    SetPinArrWidth(chip->inputs, width);
+    SetPinArrWidth(chip->outputs, width);
+
+    return chip;
+}
+
+static void BusAndOnChange(SimChip *chip) {
+    if(state.fourState) {
+        DriveMaskedPlanes(chip, 0, AndPlanes(GetInputPlanes(chip, 0), GetInputPlanes(chip, 1)));
+        return;
     }
-    printf("  }\n");
 
-    printf("}\n");
+    DriveOutput(chip, 0, GetInputState(chip, 0) & GetInputState(chip, 1));
 }
 
-void SimDestroy(void) {
-    for(size_t i = 0; i < state.chips.count; i++) {
-        SimChip chip = state.chips.items[i];
+static void BusOrOnChange(SimChip *chip) {
+    if(state.fourState) {
+        DriveMaskedPlanes(chip, 0, OrPlanes(GetInputPlanes(chip, 0), GetInputPlanes(chip, 1)));
+        return;
+    }
+
+    DriveOutput(chip, 0, GetInputState(chip, 0) | GetInputState(chip, 1));
+}
 
-        if(chip.inputs.items != NULL) free(chip.inputs.items);
-        if(chip.outputs.items != NULL) free(chip.outputs.items);
+static void BusXorOnChange(SimChip *chip) {
+    if(state.fourState) {
+        DriveMaskedPlanes(chip, 0, XorPlanes(GetInputPlanes(chip, 0), GetInputPlanes(chip, 1)));
+        return;
     }
 
-    da_free(&state.chips);
+    DriveOutput(chip, 0, GetInputState(chip, 0) ^ GetInputState(chip, 1));
+}
+
+static void BusAddOnChange(SimChip *chip) {
+    uint8_t width = chip->outputs.items[0].width;
+    uint64_t a = GetInputState(chip, 0);
+    uint64_t b = GetInputState(chip, 1);
+    uint64_t carryIn = GetInputState(chip, 2);
+
+    // an unknown bit makes unknown every bit of the sum from that bit up,
+    // including the carry out. The bits below are still known.
+    uint64_t unknown = 0;
+    if(state.fourState) {
+        uint64_t inputsUnknown = GetPinUnknown(&chip->inputs.items[0])
+            | GetPinUnknown(&chip->inputs.items[1])
+            | GetPinUnknown(&chip->inputs.items[2]);
+
+        unknown = -(inputsUnknown & -inputsUnknown);
+    }
+
+    uint64_t sum = a + b + carryIn;
+    uint64_t carryOut;
+    if(width == 64) {
+        carryOut = sum < a || (sum == a && (b | carryIn) != 0);
+    } else {
+        carryOut = (sum >> width) & 1;
+    }
+
+    uint64_t mask = GetWidthMask(width);
+    uint64_t carryUnknown = (unknown & mask) != 0;
+
+    DrivePlanes(chip, 0, (sum | unknown) & mask, unknown & mask);
+    DrivePlanes(chip, 1, carryOut | carryUnknown, carryUnknown);
+}
+
+// The single bit adder matches the gates it replaces in four state mode, an
+// unknown input only makes the carry unknown when the other two disagree
+static void FullAdderOnChange(SimChip *chip) {
+    if(state.fourState) {
+        SimPlanes a = GetInputPlanes(chip, 0);
+        SimPlanes b = GetInputPlanes(chip, 1);
+        SimPlanes carryIn = GetInputPlanes(chip, 2);
+
+        SimPlanes sum = XorPlanes(XorPlanes(a, b), carryIn);
+        SimPlanes carryOut = OrPlanes(OrPlanes(AndPlanes(a, b), AndPlanes(a, carryIn)), AndPlanes(b, carryIn));
+
+        DrivePlanes(chip, 0, sum.value & 1, sum.unknown & 1);
+        DrivePlanes(chip, 1, carryOut.value & 1, carryOut.unknown & 1);
+        return;
+    }
+
+    uint64_t a = GetInputState(chip, 0);
+    uint64_t b = GetInputState(chip, 1);
+    uint64_t carryIn = GetInputState(chip, 2);
+
+    DriveOutput(chip, 0, a ^ b ^ carryIn);
+    DriveOutput(chip, 1, (a & b) | (a & carryIn) | (b & carryIn));
+}
+
+static void BusMuxOnChange(SimChip *chip) {
+    if(state.fourState) {
+        SimPlanes a = GetInputPlanes(chip, 0);
+        SimPlanes b = GetInputPlanes(chip, 1);
+        SimPlanes select = GetInputPlanes(chip, 2);
+
+        // with an unknown select only the bits where both inputs agree are known
+        SimPlanes both = {a.value | b.value, a.unknown | b.unknown | (a.value ^ b.value)};
+
+        uint64_t pickA = (select.value & 1) - 1;
+        uint64_t pickBoth = -(select.unknown & 1);
+        uint64_t pickB = ~pickA & ~pickBoth;
+
+        SimPlanes out = {
+            (a.value & pickA) | (b.value & pickB) | (both.value & pickBoth),
+            (a.unknown & pickA) | (b.unknown & pickB) | (both.unknown & pickBoth),
+        };
+        DriveMaskedPlanes(chip, 0, out);
+        return;
+    }
+
+    DriveOutput(chip, 0, GetInputState(chip, GetInputState(chip, 2) ? 1 : 0));
+}
+
+static void BusSplitOnChange(SimChip *chip) {
+    uint64_t value = GetInputState(chip, 0);
+    uint64_t unknown = GetPinUnknown(&chip->inputs.items[0]);
+
+    for(size_t i = 0; i < chip->outputs.count; i++) {
+        SimPin *out = &chip->outputs.items[i];
+        uint64_t bit = (value >> i) & 1;
+        uint64_t unknownBit = (unknown >> i) & 1;
+
+        if(GetPinState(out) != bit || GetPinUnknown(out) != unknownBit) {
+            DrivePlanes(chip, i, bit, unknownBit);
+        }
+    }
+}
+
+static void BusJoinOnChange(SimChip *chip) {
+    uint64_t value = 0;
+    uint64_t unknown = 0;
+
+    for(size_t i = 0; i < chip->inputs.count; i++) {
+        value |= GetInputState(chip, i) << i;
+        unknown |= GetPinUnknown(&chip->inputs.items[i]) << i;
+    }
+
+    DrivePlanes(chip, 0, value, unknown);
+}
+
+static void NotOnChange(SimChip *chip) {
+    if(state.fourState) {
+        SimPlanes out = NotPlanes(GetInputPlanes(chip, 0));
+        DrivePlanes(chip, 0, out.value & 1, out.unknown & 1);
+        return;
+    }
+
+    DriveOutput(chip, 0, !GetInputState(chip, 0));
+}
+
+// the output may keep its value or take the data, the bits where they
+// differ become unknown
+static SimPlanes MergeWithOutput(SimChip *chip, SimPlanes data) {
+    SimPin *q = &chip->outputs.items[0];
+    uint64_t qValue = GetPinState(q) | GetPinUnknown(q);
+    uint64_t qUnknown = GetPinUnknown(q);
+
+    data.unknown |= qUnknown | (qValue ^ data.value);
+    data.value |= qValue;
+
+    return data;
+}
+
+static void DffOnChange(SimChip *chip) {
+    uint32_t clockIndex = chip->stateIndex;
+
+    if(state.fourState) {
+        SimPlanes prevClock = {state.pinStates.items[clockIndex], state.pinUnknown.items[clockIndex]};
+        SimPlanes clock = GetInputPlanes(chip, 1);
+
+        state.pinStates.items[clockIndex] = clock.value & 1;
+        state.pinUnknown.items[clockIndex] = clock.unknown & 1;
+
+        // an unknown clock that stays unknown isn't an edge
+        bool clockChanged = ((prevClock.value ^ clock.value) | (prevClock.unknown ^ clock.unknown)) & 1;
+        if(!clockChanged) return;
+
+        LogWrite(SIM_LOG_SLOT, NULL, clockIndex, clock.value & 1, clock.unknown & 1);
+
+        bool mayBeLow = (prevClock.unknown & 1) || !(prevClock.value & 1);
+        bool mayBeHigh = clock.value & 1;
+        if(!mayBeLow || !mayBeHigh) return;
+
+        SimPlanes data = GetInputPlanes(chip, 0);
+        if((prevClock.unknown | clock.unknown) & 1) data = MergeWithOutput(chip, data);
+
+        DrivePlanes(chip, 0, data.value & 1, data.unknown & 1);
+        return;
+    }
+
+    uint64_t prevClock = state.pinStates.items[clockIndex];
+    uint64_t clock = GetInputState(chip, 1);
+
+    state.pinStates.items[clockIndex] = clock;
+    if(prevClock != clock) LogWrite(SIM_LOG_SLOT, NULL, clockIndex, clock, 0);
+
+    if(!prevClock && clock) {
+        DriveOutput(chip, 0, GetInputState(chip, 0));
+    }
+}
+
+static void LatchOnChange(SimChip *chip) {
+    if(state.fourState) {
+        SimPlanes enable = GetInputPlanes(chip, 1);
+        if(!(enable.value & 1)) return;
+
+        SimPlanes data = GetInputPlanes(chip, 0);
+        if(enable.unknown & 1) data = MergeWithOutput(chip, data);
+
+        DrivePlanes(chip, 0, data.value & 1, data.unknown & 1);
+        return;
+    }
+
+    if(GetInputState(chip, 1)) DriveOutput(chip, 0, GetInputState(chip, 0));
+}
+
+static void TristateOnChange(SimChip *chip) {
+    uint64_t mask = GetWidthMask(chip->outputs.items[0].width);
+
+    if(state.fourState) {
+        SimPlanes enable = GetInputPlanes(chip, 1);
+
+        if(enable.unknown & 1) {
+            // it may or may not be driving, the net sees X
+            DrivePlanes(chip, 0, mask, mask);
+            DriveOutput(chip, 1, SIM_PIN_ON);
+        } else if(enable.value & 1) {
+            SimPlanes data = GetInputPlanes(chip, 0);
+            DrivePlanes(chip, 0, data.value, data.unknown);
+            DriveOutput(chip, 1, SIM_PIN_ON);
+        } else {
+            DrivePlanes(chip, 0, 0, mask);
+            DriveOutput(chip, 1, SIM_PIN_OFF);
+        }
+
+        return;
+    }
+
+    uint64_t enable = GetInputState(chip, 1);
+    DriveOutput(chip, 0, enable ? GetInputState(chip, 0) : 0);
+    DriveOutput(chip, 1, enable);
+}
+
+typedef void (*SimChipEval)(SimChip*);
+
+// the function that updates the outputs of each type of chip, the leds and
+// the inputs are never evaluated
+static const SimChipEval chipEvals[] = {
+    [CHIP_NAND] = NandOnChange,
+    [CHIP_AND] = BusAndOnChange,
+    [CHIP_OR] = BusOrOnChange,
+    [CHIP_XOR] = BusXorOnChange,
+    [CHIP_NOT] = NotOnChange,
+    [CHIP_MUX] = BusMuxOnChange,
+    [CHIP_FULL_ADDER] = FullAdderOnChange,
+    [CHIP_DFF] = DffOnChange,
+    [CHIP_LATCH] = LatchOnChange,
+    [CHIP_BUS_AND] = BusAndOnChange,
+    [CHIP_BUS_OR] = BusOrOnChange,
+    [CHIP_BUS_XOR] = BusXorOnChange,
+    [CHIP_BUS_ADD] = BusAddOnChange,
+    [CHIP_BUS_MUX] = BusMuxOnChange,
+    [CHIP_BUS_SPLIT] = BusSplitOnChange,
+    [CHIP_BUS_JOIN] = BusJoinOnChange,
+    [CHIP_TRISTATE] = TristateOnChange,
+    [CHIP_LED] = NULL,
+    [CHIP_INPUT] = NULL,
+};
+
+#define SIM_CHIP_TYPE_COUNT (sizeof(chipEvals)/sizeof(chipEvals[0]))
+
+static inline bool IsEvaluated(SimChip *chip) {
+    return chipEvals[chip->type] != NULL;
+}
+
+static inline void EvaluateChip(SimChip *chip) {
+    // the NANDs are most of the chips of the imported circuits
+    if(chip->type == CHIP_NAND) {
+        NandOnChange(chip);
+    } else {
+        chipEvals[chip->type](chip);
+    }
+}
+
+SimChip *SimBusInputCreate(uint8_t width) {
+    SimChip *input = CreateBusChip(CHIP_INPUT, width, 0, 1);
+
+    // in four state mode the inputs are unknown until they're set
+    if(state.fourState) {
+        uint32_t index = input->outputs.items[0].stateIndex;
+        state.pinStates.items[index] = GetWidthMask(width);
+        state.pinUnknown.items[index] = GetWidthMask(width);
+    }
+
+    return input;
+}
+
+SimChip *SimBusLedCreate(uint8_t width) {
+    return CreateBusChip(CHIP_LED, width, 1, 0);
+}
+
+SimChip *SimBusAndCreate(uint8_t width) {
+    return CreateBusChip(CHIP_BUS_AND, width, 2, 1);
+}
+
+SimChip *SimBusOrCreate(uint8_t width) {
+    return CreateBusChip(CHIP_BUS_OR, width, 2, 1);
+}
+
+SimChip *SimBusXorCreate(uint8_t width) {
+    return CreateBusChip(CHIP_BUS_XOR, width, 2, 1);
+}
+
+SimChip *SimBusAddCreate(uint8_t width) {
+    SimChip *add = CreateBusChip(CHIP_BUS_ADD, width, 3, 2);
+
+    add->inputs.items[2].width = 1;
+    add->outputs.items[1].width = 1;
+
+    return add;
+}
+
+SimChip *SimBusMuxCreate(uint8_t width) {
+    SimChip *mux = CreateBusChip(CHIP_BUS_MUX, width, 3, 1);
+
+    mux->inputs.items[2].width = 1;
+
+    return mux;
+}
+
+SimChip *SimBusSplitCreate(uint8_t width) {
+    SimChip *split = CreateBusChip(CHIP_BUS_SPLIT, width, 1, width);
+
+    SetPinArrWidth(split->outputs, 1);
+
+    return split;
+}
+
+SimChip *SimBusJoinCreate(uint8_t width) {
+    SimChip *join = CreateBusChip(CHIP_BUS_JOIN, width, width, 1);
+
+    SetPinArrWidth(join->inputs, 1);
+
+    return join;
+}
+
+// the single bit gates share the evaluators of the bus chips
+
+SimChip *SimAndCreate(void) {
+    return CreateBusChip(CHIP_AND, 1, 2, 1);
+}
+
+SimChip *SimOrCreate(void) {
+    return CreateBusChip(CHIP_OR, 1, 2, 1);
+}
+
+SimChip *SimXorCreate(void) {
+    return CreateBusChip(CHIP_XOR, 1, 2, 1);
+}
+
+SimChip *SimNotCreate(void) {
+    SimChip *not = CreateBusChip(CHIP_NOT, 1, 1, 1);
+
+    // the input starts off, so the output is already settled
+    state.pinStates.items[not->outputs.items[0].stateIndex] = SIM_PIN_ON;
+
+    return not;
+}
+
+SimChip *SimMuxCreate(void) {
+    return CreateBusChip(CHIP_MUX, 1, 3, 1);
+}
+
+SimChip *SimFullAdderCreate(void) {
+    return CreateBusChip(CHIP_FULL_ADDER, 1, 3, 2);
+}
+
+SimChip *SimDffCreate(void) {
+    SimChip *dff = CreateBusChip(CHIP_DFF, 1, 2, 1);
+
+    // the last clock seen, to find the rising edges
+    dff->stateIndex = AllocStateSlot();
+    dff->inputs.items[0].passive = true;
+
+    return dff;
+}
+
+SimChip *SimLatchCreate(void) {
+    return CreateBusChip(CHIP_LATCH, 1, 2, 1);
+}
+
+SimChip *SimTristateCreate(uint8_t width) {
+    SimChip *tristate = CreateBusChip(CHIP_TRISTATE, width, 2, 2);
+
+    tristate->inputs.items[1].width = 1;
+    tristate->outputs.items[1].width = 1;
+
+    // disabled, so the output is Z
+    if(state.fourState) {
+        state.pinUnknown.items[tristate->outputs.items[0].stateIndex] = GetWidthMask(width);
+    }
+
+    return tristate;
+}
+
+static bool UsesLevels(void) {
+    return state.engine == SIM_ENGINE_LEVELIZED && !state.building;
+}
+
+static void EnsureLevelBuckets(size_t level) {
+    while(state.levelBuckets.count <= level) {
+        da_append(&state.levelBuckets, ((SimEventQueue){0}));
+    }
+}
+
+static void PushEvent(SimPin *inPin) {
+    if(UsesLevels()) {
+        uint32_t level = inPin->parentChip->level;
+        EnsureLevelBuckets(level);
+
+        da_append(&state.levelBuckets.items[level], inPin);
+        state.levelEvents++;
+        if(level < state.nextLevel) state.nextLevel = level;
+    } else {
+        da_append(&state.events, inPin);
+    }
+}
+
+static void ScheduleChip(SimPin *inPin) {
+    SimChip *chip = inPin->parentChip;
+
+    assert(chip != NULL);
+    if(!IsEvaluated(chip)) return;
+
+    if(chip->scheduled) return;
+
+    // the cycles evaluate the scheduled chips in topological order, they
+    // don't need a queue
+    if(state.cycle.running) {
+        chip->scheduled = true;
+        return;
+    }
+
+    // the chips out of the cone are evaluated once they join it
+    if(state.demand.enabled && !chip->observed) {
+        chip->stale = true;
+        return;
+    }
+
+    chip->scheduled = true;
+    PushEvent(inPin);
+}
+
+static bool HasEvents(void) {
+    return state.events.count > 0 || state.levelEvents > 0;
+}
+
+static uint64_t GetConeVersion(void) {
+    return state.demand.enabled ? state.demand.coneVersion : 0;
+}
+
+static bool IsConeOutdated(void) {
+    return state.demand.enabled && (state.demand.dirty || state.demand.netlistVersion != state.netlistVersion);
+}
+
+static void ObserveChip(SimChip *chip) {
+    if(chip->observed) return;
+
+    chip->observed = true;
+    state.demand.coneSize++;
+    da_append(&state.demand.stack, chip);
+}
+
+// the chips driving an input pin, directly or through its net
+static void ObservePinDrivers(SimPin *inPin) {
+    if(inPin->source != NULL) ObserveChip(inPin->source->parentChip);
+
+    for(size_t i = 0; inPin->net != NULL && i < inPin->net->drivers.count; i++) {
+        ObserveChip(inPin->net->drivers.items[i]->parentChip);
+    }
+}
+
+static void ObservePin(SimPin *pin) {
+    if(pin->isInput) {
+        ObservePinDrivers(pin);
+    } else {
+        ObserveChip(pin->parentChip);
+    }
+}
+
+// Computes the cone of influence again walking back from the observed pins,
+// the stale chips that joined it are scheduled
+static void UpdateCone(void) {
+    if(!IsConeOutdated()) return;
+
+    for(size_t i = 0; i < state.chips.count; i++) {
+        state.chips.items[i]->observed = false;
+    }
+    state.demand.coneSize = 0;
+
+    for(size_t i = 0; i < state.chips.count; i++) {
+        if(state.chips.items[i]->type == CHIP_LED) ObserveChip(state.chips.items[i]);
+    }
+
+    for(size_t i = 0; i < state.demand.probes.count; i++) {
+        ObservePin(state.demand.probes.items[i]);
+    }
+
+    for(size_t i = 0; i < state.watch.watches.count; i++) {
+        ObservePin(state.watch.watches.items[i].pin);
+    }
+
+    while(state.demand.stack.count > 0) {
+        SimChip *chip = state.demand.stack.items[--state.demand.stack.count];
+
+        for(size_t i = 0; i < chip->inputs.count; i++) {
+            ObservePinDrivers(&chip->inputs.items[i]);
+        }
+    }
+
+    state.demand.dirty = false;
+    state.demand.netlistVersion = state.netlistVersion;
+    state.demand.coneVersion++;
+
+    for(size_t i = 0; i < state.chips.count; i++) {
+        SimChip *chip = state.chips.items[i];
+
+        if(chip->observed && chip->stale) {
+            chip->stale = false;
+            ScheduleChip(&chip->inputs.items[0]);
+        }
+    }
+}
+
+// Schedules every chip (or the ones out of the cone, which only marks them
+// as stale). Used when the outputs may not match the inputs
+static void InvalidateChips(bool all) {
+    for(size_t i = 0; i < state.chips.count; i++) {
+        SimChip *chip = state.chips.items[i];
+        if(chip->inputs.count > 0 && (all || !chip->observed)) ScheduleChip(&chip->inputs.items[0]);
+    }
+}
+
+static bool IsDriving(SimPin *driver) {
+    SimChip *chip = driver->parentChip;
+
+    if(chip->type == CHIP_TRISTATE) return GetPinState(&chip->outputs.items[1]) == SIM_PIN_ON;
+    return true;
+}
+
+static void MarkNetDirty(SimNet *net) {
+    if(net->dirty) return;
+
+    net->dirty = true;
+    da_append(&state.dirtyNets, net);
+}
+
+static void UpdateNetDriver(SimNet *net, uint32_t index) {
+    uint64_t bit = (uint64_t)1 << (index % 64);
+    uint64_t *word = &net->activeDrivers.items[index / 64];
+
+    if(IsDriving(net->drivers.items[index])) {
+        *word |= bit;
+    } else {
+        *word &= ~bit;
+    }
+
+    MarkNetDirty(net);
+}
+
+// O(1) thanks to SimPin.forcedIndex, the last forced pin takes the place of
+// the removed one
+static void RemoveForcedPin(SimPin *inPin) {
+    if(!inPin->forced) return;
+
+    uint32_t index = inPin->forcedIndex;
+    assert(state.forcedPins.items[index] == inPin);
+
+    da_remove_unordered(&state.forcedPins, index);
+    if(index < state.forcedPins.count) state.forcedPins.items[index]->forcedIndex = index;
+
+    inPin->forced = false;
+}
+
+static void AddForcedPin(SimPin *inPin) {
+    inPin->forced = true;
+    inPin->forcedIndex = state.forcedPins.count;
+    da_append(&state.forcedPins, inPin);
+}
+
+// The pin starts reading the slot of its driver, its chip sees the change
+// like the ones made by PropagatePinState. Pulling and forcing a pin changes
+// where its state is stored, not the netlist
+static void PullPin(SimPin *inPin, uint32_t slot) {
+    if(inPin->pulled) return;
+
+    uint64_t value = state.pinStates.items[slot];
+    uint64_t unknown = state.fourState ? state.pinUnknown.items[slot] : 0;
+    bool changed = GetPinState(inPin) != value || GetPinUnknown(inPin) != unknown;
+
+    if(IsSlotWatched(inPin->readIndex)) CheckWatches(inPin->readIndex, value, unknown);
+    RemoveForcedPin(inPin);
+
+    inPin->readIndex = slot;
+    inPin->pulled = true;
+    // none while the history replays, see SimHistoryGoTo
+    if(state.watch.slots.count > 0) RebuildWatchSlots();
+
+    if(changed && !inPin->passive) ScheduleChip(inPin);
+}
+
+// the pin keeps the state of its driver in its own slot
+static void UnpullPin(SimPin *inPin) {
+    state.pinStates.items[inPin->stateIndex] = state.pinStates.items[inPin->readIndex];
+    if(state.fourState) state.pinUnknown.items[inPin->stateIndex] = state.pinUnknown.items[inPin->readIndex];
+
+    inPin->readIndex = inPin->stateIndex;
+    inPin->pulled = false;
+    if(state.watch.slots.count > 0) RebuildWatchSlots();
+}
+
+// a pulled pin set from outside, it's pulled again once its driver changes
+static void ForcePin(SimPin *inPin) {
+    UnpullPin(inPin);
+    AddForcedPin(inPin);
+}
+
+// called before the pin leaves its driver
+static void ReleasePin(SimPin *inPin) {
+    if(inPin->pulled) {
+        UnpullPin(inPin);
+    } else {
+        RemoveForcedPin(inPin);
+    }
+}
+
+// "unknown" is ignored in two state mode
+static void PropagatePinState(SimPin *pin, uint64_t pinState, uint64_t unknown) {
+    if(IsSlotWatched(pin->stateIndex)) CheckWatches(pin->stateIndex, pinState, unknown);
+    if(state.coverage.enabled) RecordToggles(pin->stateIndex, pinState, unknown);
+
+    if(pin->isInput) {
+        if(GetPinState(pin) != pinState || GetPinUnknown(pin) != unknown) {
+            // writing the slot of the driver would change its other targets
+            if(pin->pulled) ForcePin(pin);
+
+            state.pinStates.items[pin->stateIndex] = pinState;
+            if(state.fourState) state.pinUnknown.items[pin->stateIndex] = unknown;
+            if(!pin->passive) ScheduleChip(pin);
+        }
+    } else {
+        if(state.activity.enabled) CountToggles(pin->stateIndex, pinState, unknown);
+
+        bool changed = GetPinState(pin) != pinState || GetPinUnknown(pin) != unknown;
+        bool pulls = pin->connectedTargets.count >= SIM_PULL_MIN_FANOUT;
+        state.pinStates.items[pin->stateIndex] = pinState;
+        if(state.fourState) state.pinUnknown.items[pin->stateIndex] = unknown;
+
+        for(size_t i = 0; i < pin->connectedTargets.count; i++) {
+            SimPin *target = pin->connectedTargets.items[i];
+
+            if(target->pulled) {
+                if(changed && !target->passive) ScheduleChip(target);
+            } else if(pulls) {
+                PullPin(target, pin->stateIndex);
+            } else {
+                PropagatePinState(target, pinState, unknown);
+            }
+        }
+
+        if(pin->net != NULL) UpdateNetDriver(pin->net, pin->netIndex);
+    }
+}
+
+static void SetPinState(SimPin *pin, uint64_t pinState, uint64_t unknown) {
+    LogWrite(SIM_LOG_PIN, pin, pin->stateIndex, pinState, unknown);
+    PropagatePinState(pin, pinState, unknown);
+}
+
+static void ApplyUpdates(SimUpdateQueue *queue) {
+    for(size_t i = 0; i < queue->count; i++) {
+        SimPinUpdate update = queue->items[i];
+
+        if(GetPinState(update.pin) != update.state || GetPinUnknown(update.pin) != update.unknown) {
+            SetPinState(update.pin, update.state, update.unknown);
+        }
+    }
+
+    queue->count = 0;
+}
+
+static void SetNetState(SimNet *net, uint64_t value, uint64_t unknown) {
+    // for the pulled targets
+    if(IsSlotWatched(net->stateIndex)) CheckWatches(net->stateIndex, value, unknown);
+    if(state.coverage.enabled) RecordToggles(net->stateIndex, value, unknown);
+
+    bool changed = state.pinStates.items[net->stateIndex] != value
+        || (state.fourState && state.pinUnknown.items[net->stateIndex] != unknown);
+    bool pulls = net->targets.count >= SIM_PULL_MIN_FANOUT;
+
+    state.pinStates.items[net->stateIndex] = value;
+    if(state.fourState) state.pinUnknown.items[net->stateIndex] = unknown;
+
+    for(size_t i = 0; i < net->targets.count; i++) {
+        SimPin *target = net->targets.items[i];
+
+        if(target->pulled) {
+            if(changed && !target->passive) ScheduleChip(target);
+        } else if(pulls) {
+            PullPin(target, net->stateIndex);
+        } else {
+            PropagatePinState(target, value, unknown);
+        }
+    }
+}
+
+// Every bit is resolved on its own from the active drivers, only the set
+// bits of the bitmap are visited. Without four state the unknown bits are
+// always 0, so the value is the OR of the drivers.
+static void ResolveNet(SimNet *net) {
+    uint64_t drive0 = 0, drive1 = 0, driveX = 0;
+
+    for(size_t w = 0; w < net->activeDrivers.count; w++) {
+        uint64_t active = net->activeDrivers.items[w];
+
+        while(active != 0) {
+            SimPin *driver = net->drivers.items[w*64 + __builtin_ctzll(active)];
+            active &= active - 1;
+
+            uint64_t value = GetPinState(driver);
+            uint64_t unknown = GetPinUnknown(driver);
+
+            // Z bits of a driver don't drive anything
+            drive0 |= ~value & ~unknown;
+            drive1 |= value & ~unknown;
+            driveX |= value & unknown;
+        }
+    }
+
+    uint64_t mask = GetWidthMask(net->width);
+    uint64_t x = (driveX | (drive0 & drive1)) & mask;
+    uint64_t z = ~(drive0 | drive1 | driveX) & mask;
+
+    uint64_t value = (drive1 | x) & mask;
+    uint64_t unknown = state.fourState ? x | z : 0;
+
+    LogWrite(SIM_LOG_NET, net, net->stateIndex, value, unknown);
+    SetNetState(net, value, unknown);
+}
+
+static void ResolveNets(void) {
+    for(size_t i = 0; i < state.dirtyNets.count; i++) {
+        SimNet *net = state.dirtyNets.items[i];
+        net->dirty = false;
+        ResolveNet(net);
+    }
+
+    state.dirtyNets.count = 0;
+}
+
+// Sorts the events by the type of their chip (counting sort), so the chips
+// of a type are evaluated one after the other and the dispatch is predictable.
+// The chips of a step or a level don't see each other's outputs, so their
+// order doesn't change the result.
+static void GroupEventsByType(SimEventQueue *queue) {
+    if(queue->count < SIM_GROUP_MIN_EVENTS) return;
+
+    size_t starts[SIM_CHIP_TYPE_COUNT] = {0};
+
+    for(size_t i = 0; i < queue->count; i++) {
+        starts[queue->items[i]->parentChip->type]++;
+    }
+
+    size_t next = 0;
+    for(size_t i = 0; i < SIM_CHIP_TYPE_COUNT; i++) {
+        size_t count = starts[i];
+        starts[i] = next;
+        next += count;
+    }
+
+    SimEventQueue *grouped = &state.grouped;
+    if(grouped->capacity < queue->count) {
+        grouped->capacity = queue->capacity;
+        grouped->items = realloc(grouped->items, grouped->capacity*sizeof(SimPin*));
+        assert(grouped->items != NULL && "No enough ram");
+    }
+
+    for(size_t i = 0; i < queue->count; i++) {
+        SimPin *pin = queue->items[i];
+        grouped->items[starts[pin->parentChip->type]++] = pin;
+    }
+
+    grouped->count = queue->count;
+
+    // the queues swap their memory instead of copying it back
+    SimEventQueue sorted = *grouped;
+    *grouped = *queue;
+    *queue = sorted;
+}
+
+static void FreeCheckpoint(SimCheckpoint *checkpoint) {
+    state.history.usedBytes -= checkpoint->snapshotBytes + checkpoint->log.count*sizeof(SimLogEntry);
+    SimSnapshotFree(checkpoint->snapshot);
+    da_free(&checkpoint->log);
+}
+
+static void HistoryClear(void) {
+    for(size_t i = 0; i < state.history.checkpoints.count; i++) {
+        FreeCheckpoint(&state.history.checkpoints.items[i]);
+    }
+
+    state.history.checkpoints.count = 0;
+}
+
+static void TakeCheckpoint(void) {
+    SimCheckpoint checkpoint = {
+        .step = state.stepCount,
+        .snapshot = SimSnapshot(),
+    };
+
+    SimStateSnapshot *snapshot = checkpoint.snapshot;
+    checkpoint.snapshotBytes = sizeof(SimStateSnapshot) + (snapshot->eventCount + snapshot->forcedCount)*sizeof(SimPin*)
+        + snapshot->pinCount*sizeof(uint64_t)*(snapshot->pinUnknown != NULL ? 2 : 1);
+
+    da_append(&state.history.checkpoints, checkpoint);
+    state.history.usedBytes += checkpoint.snapshotBytes;
+}
+
+// drops the oldest checkpoints until the history fits in its limit
+static void TrimHistory(void) {
+    size_t drop = 0;
+
+    while(state.history.usedBytes > state.history.maxBytes && state.history.checkpoints.count - drop > 1) {
+        FreeCheckpoint(&state.history.checkpoints.items[drop]);
+        drop++;
+    }
+
+    if(drop == 0) return;
+
+    state.history.checkpoints.count -= drop;
+    memmove(state.history.checkpoints.items, state.history.checkpoints.items + drop,
+        state.history.checkpoints.count*sizeof(SimCheckpoint));
+}
+
+static void HistoryRestart(void) {
+    HistoryClear();
+
+    state.history.netlistVersion = state.netlistVersion;
+    state.history.engine = state.engine;
+    state.history.fourState = state.fourState;
+    state.history.coneVersion = GetConeVersion();
+
+    TakeCheckpoint();
+}
+
+static bool IsHistoryOutdated(void) {
+    return state.history.netlistVersion != state.netlistVersion
+        || state.history.engine != state.engine
+        || state.history.fourState != state.fourState
+        || state.history.coneVersion != GetConeVersion();
+}
+
+// called by BeginStep before taking the events of the step
+static void RecordStepStart(void) {
+    if(IsHistoryOutdated()) {
+        HistoryRestart();
+        return;
+    }
+
+    SimCheckpoint *last = &state.history.checkpoints.items[state.history.checkpoints.count - 1];
+    bool intervalPassed = state.history.interval > 0 && state.stepCount - last->step >= state.history.interval;
+
+    bool logFull = last->log.count*sizeof(SimLogEntry)*SIM_HISTORY_LOG_FRACTION >= last->snapshotBytes;
+
+    if(intervalPassed || logFull) {
+        TakeCheckpoint();
+        TrimHistory();
+    }
+}
+
+// Starts a step: the event driven engine takes every pending event and the
+// levelized one the lowest level with events. Returns false if there are no
+// events.
+static bool BeginStep(void) {
+    // the nets changed by the edits made since the last step
+    ResolveNets();
+    UpdateCone();
+
+    if(state.history.enabled && HasEvents()) RecordStepStart();
+
+    SimEventQueue *queue;
+    uint64_t level = SIM_LOG_ALL_LEVELS;
+
+    if(UsesLevels()) {
+        while(state.nextLevel < state.levelBuckets.count && state.levelBuckets.items[state.nextLevel].count == 0) {
+            state.nextLevel++;
+        }
+
+        if(state.nextLevel >= state.levelBuckets.count) return false;
+
+        state.stepLevel = state.nextLevel;
+        queue = &state.levelBuckets.items[state.stepLevel];
+        level = state.stepLevel;
+    } else {
+        if(state.events.count == 0) return false;
+
+        // the events scheduled while processing this step go to the next one
+        SimEventQueue processing = state.events;
+        state.events = state.processing;
+        state.events.count = 0;
+        state.processing = processing;
+
+        queue = &state.processing;
+    }
+
+    GroupEventsByType(queue);
+
+    if(state.history.enabled) {
+        LogWrite(SIM_LOG_STEP, NULL, 0, state.stepCount, level);
+        TrimHistory();
+    }
+
+    state.stepping = true;
+    state.steppingLevel = UsesLevels();
+    state.stepCursor = 0;
+
+    return true;
+}
+
+// the events of the current step. Applying updates can schedule chips of
+// levels that have no bucket yet, which reallocates the buckets, so the
+// pointer is only valid until the next update
+static SimEventQueue *GetStepQueue(void) {
+    return state.steppingLevel ? &state.levelBuckets.items[state.stepLevel] : &state.processing;
+}
+
+// evaluates up to "maxEvents" events of the current step and returns how
+// many were evaluated, the step ends after its last event
+static size_t ContinueStep(size_t maxEvents) {
+    assert(state.stepping);
+
+    size_t count = GetStepQueue()->count;
+    size_t start = state.stepCursor;
+    size_t end = count - start > maxEvents ? start + maxEvents : count;
+
+    for(size_t i = start; i < end; i++) {
+        SimPin *pin = GetStepQueue()->items[i];
+        pin->parentChip->scheduled = false;
+        EvaluateChip(pin->parentChip);
+
+        // the chips of a level only drive chips of higher levels, so their
+        // outputs can be applied right away without adding events to the
+        // level being processed
+        if(state.steppingLevel) {
+            ApplyUpdates(&state.updates);
+
+            // a watch stops the level right after the chip that triggered it
+            if(state.watch.stopped) {
+                end = i + 1;
+                break;
+            }
+        }
+    }
+
+    state.stepCursor = end;
+    state.eventCount += end - start;
+    if(end < GetStepQueue()->count) return end - start;
+
+    if(state.steppingLevel) {
+        GetStepQueue()->count = 0;
+        state.levelEvents -= end;
+    } else {
+        ApplyUpdates(&state.updates);
+    }
+
+    // second phase of the sequential chips
+    ApplyUpdates(&state.clockedUpdates);
+
+    ResolveNets();
+
+    state.stepping = false;
+    state.stepCount++;
+
+    return end - start;
+}
+
+// the edits that reorganize the events need the current step to be complete
+static void FinishStep(void) {
+    while(state.stepping) ContinueStep(SIZE_MAX);
+}
+
+static bool IsSettled(void) {
+    return !state.stepping && !HasEvents() && state.dirtyNets.count == 0;
+}
+
+// moves the pending events to the queue used by the current engine
+static void RequeueEvents(void) {
+    FinishStep();
+
+    SimEventQueue *pending = &state.processing;
+    pending->count = 0;
+
+    if(state.events.count > 0) {
+        da_append_many(pending, state.events.items, state.events.count);
+        state.events.count = 0;
+    }
+
+    for(size_t i = 0; i < state.levelBuckets.count; i++) {
+        SimEventQueue *bucket = &state.levelBuckets.items[i];
+
+        if(bucket->count > 0) {
+            da_append_many(pending, bucket->items, bucket->count);
+            bucket->count = 0;
+        }
+    }
+
+    state.levelEvents = 0;
+    state.nextLevel = 0;
+
+    for(size_t i = 0; i < pending->count; i++) {
+        PushEvent(pending->items[i]);
+    }
+
+    pending->count = 0;
+}
+
+
+size_t SimGetFanOutCount(SimPin *out) {
+    return out->connectedTargets.count + (out->net != NULL ? out->net->targets.count : 0);
+}
+
+SimPin *SimGetFanOutTarget(SimPin *out, size_t index) {
+    if(index < out->connectedTargets.count) return out->connectedTargets.items[index];
+    return out->net->targets.items[index - out->connectedTargets.count];
+}
+
+// Kahn's algorithm, fills "order" with the chips sorted topologically and
+// returns how many were sorted. The chips that are part of a loop (or
+// driven by one) are left out.
+static size_t SortTopologically(SimChip **order) {
+    size_t count = state.chips.count;
+    uint32_t *pending = calloc(count, sizeof(uint32_t));
+    assert(pending != NULL && "No enough ram");
+
+    // number of connections arriving to each chip
+    for(size_t i = 0; i < count; i++) {
+        SimChip *chip = state.chips.items[i];
+
+        for(size_t j = 0; j < chip->outputs.count; j++) {
+            SimPin *out = &chip->outputs.items[j];
+
+            for(size_t k = 0; k < SimGetFanOutCount(out); k++) {
+                SimPin *target = SimGetFanOutTarget(out, k);
+                if(!target->passive) pending[target->parentChip->index]++;
+            }
+        }
+    }
+
+    size_t head = 0, tail = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(pending[i] == 0) order[tail++] = state.chips.items[i];
+    }
+
+    while(head < tail) {
+        SimChip *chip = order[head++];
+
+        for(size_t j = 0; j < chip->outputs.count; j++) {
+            SimPin *out = &chip->outputs.items[j];
+
+            for(size_t k = 0; k < SimGetFanOutCount(out); k++) {
+                SimPin *target = SimGetFanOutTarget(out, k);
+                if(!target->passive && --pending[target->parentChip->index] == 0) order[tail++] = target->parentChip;
+            }
+        }
+    }
+
+    free(pending);
+    return tail;
+}
+
+// Settling a freshly built circuit with SimSettle would evaluate the same
+// chips over and over, since every chip starts with its default outputs.
+// Evaluating them in topological order does it once per chip, only the
+// chips that are part of a loop are left in the event queue.
+static void EvaluateInTopologicalOrder(void) {
+    SimChip **order = malloc(state.chips.count*sizeof(SimChip*));
+    assert(order != NULL && "No enough ram");
+
+    size_t count = SortTopologically(order);
+
+    ResolveNets();
+
+    for(size_t i = 0; i < count; i++) {
+        SimChip *chip = order[i];
+
+        // the flip-flops keep their initial output, the clock they see now
+        // isn't an edge (see SyncFlipFlopClocks)
+        if(chip->type == CHIP_DFF) continue;
+
+        if(IsEvaluated(chip)) {
+            chip->scheduled = false;
+            chip->stale = false;
+            EvaluateChip(chip);
+            ApplyUpdates(&state.updates);
+            ApplyUpdates(&state.clockedUpdates);
+            ResolveNets();
+        }
+    }
+
+    // the chips evaluated after being scheduled are already up to date
+    size_t events = 0;
+    for(size_t i = 0; i < state.events.count; i++) {
+        SimPin *pin = state.events.items[i];
+        if(pin->parentChip->scheduled) state.events.items[events++] = pin;
+    }
+    state.events.count = events;
+
+    free(order);
+}
+
+// computes the level of every chip from scratch, the drivers of a chip
+// always get a lower level. Returns false if the circuit has loops.
+static bool LevelizeAll(void) {
+    SimChip **order = malloc(state.chips.count*sizeof(SimChip*));
+    assert(order != NULL && "No enough ram");
+
+    size_t count = SortTopologically(order);
+    if(count < state.chips.count) {
+        free(order);
+        return false;
+    }
+
+    for(size_t i = 0; i < count; i++) {
+        order[i]->level = 0;
+    }
+
+    uint32_t maxLevel = 0;
+    for(size_t i = 0; i < count; i++) {
+        SimChip *chip = order[i];
+        if(chip->level > maxLevel) maxLevel = chip->level;
+
+        for(size_t j = 0; j < chip->outputs.count; j++) {
+            SimPin *out = &chip->outputs.items[j];
+
+            for(size_t k = 0; k < SimGetFanOutCount(out); k++) {
+                SimPin *target = SimGetFanOutTarget(out, k);
+                if(!target->passive && target->parentChip->level <= chip->level) target->parentChip->level = chip->level + 1;
+            }
+        }
+    }
+
+    EnsureLevelBuckets(maxLevel);
+    state.levelPatches = 0;
+
+    free(order);
+    return true;
+}
+
+static void Relevelize(void) {
+    if(!LevelizeAll()) {
+        log_error("The circuit has a loop, switching to the event driven engine");
+        state.engine = SIM_ENGINE_EVENT;
+    }
+
+    RequeueEvents();
+}
+
+static size_t GetRelevelizeLimit(void) {
+    size_t limit = state.chips.count / 8;
+    return limit > SIM_RELEVELIZE_MIN_PATCHES ? limit : SIM_RELEVELIZE_MIN_PATCHES;
+}
+
+// Raises the levels of "to" and the chips after it so they stay above "from"
+// after connecting them. Only the chips that need a new level are visited.
+// Returns false when the connection closes a loop or too many chips were
+// patched since the last full levelization, the caller must relevelize.
+static bool PatchLevels(SimChip *from, SimChip *to) {
+    if(to->level > from->level) return true;
+
+    size_t limit = GetRelevelizeLimit();
+
+    state.levelStack.count = 0;
+    da_append(&state.levelStack, ((SimLevelPatch){to, from->level + 1}));
+
+    while(state.levelStack.count > 0) {
+        SimLevelPatch patch = state.levelStack.items[--state.levelStack.count];
+        SimChip *chip = patch.chip;
+
+        if(chip->level >= patch.level) continue;
+        if(chip == from) return false;
+        if(++state.levelPatches > limit) return false;
+
+        chip->level = patch.level;
+
+        for(size_t j = 0; j < chip->outputs.count; j++) {
+            SimPin *out = &chip->outputs.items[j];
+
+            for(size_t k = 0; k < SimGetFanOutCount(out); k++) {
+                SimPin *target = SimGetFanOutTarget(out, k);
+
+                if(!target->passive && target->parentChip->level <= patch.level) {
+                    da_append(&state.levelStack, ((SimLevelPatch){target->parentChip, patch.level + 1}));
+                }
+            }
+        }
+    }
+
+    // chips that are already waiting in a bucket keep their old level until
+    // they're evaluated, that only costs an extra evaluation
+    return true;
+}
+
+// settles the circuit after an edit unless the user steps it
+static void AutoSettle(void) {
+    if(!state.manualSettle) SimSettle();
+}
+
+void SimSetInputPinState(SimChip *chip, size_t index, uint64_t pinState) {
+    assert(index < chip->inputs.count);
+    if(state.stimulusHook != NULL && !state.building) state.stimulusHook(chip, true, index, pinState, 0);
+
+    SimPin *pin = &chip->inputs.items[index];
+    SetPinState(pin, pinState & GetWidthMask(pin->width), 0);
+    if(!state.building) AutoSettle();
+}
+
+void SimSetOutputPinState(SimChip *chip, size_t index, uint64_t pinState) {
+    SimSetOutputPinPlanes(chip, index, pinState, 0);
+}
+
+void SimSetOutputPinPlanes(SimChip *chip, size_t index, uint64_t value, uint64_t unknown) {
+    assert(index < chip->outputs.count);
+    if(state.stimulusHook != NULL && !state.building) state.stimulusHook(chip, false, index, value, unknown);
+
+    SimPin *pin = &chip->outputs.items[index];
+    uint64_t mask = GetWidthMask(pin->width);
+    SetPinState(pin, value & mask, unknown & mask);
+    if(!state.building) AutoSettle();
+}
+
+SimPin *SimGetInputPin(SimChip *chip, size_t index) {
+    assert(index < chip->inputs.count);
+    return &chip->inputs.items[index];
+}
+SimPin *SimGetOutputPin(SimChip *chip, size_t index) {
+    assert(index < chip->outputs.count);
+    return &chip->outputs.items[index];
+}
+
+static void ConnectPins(SimPin *outPin, SimPin *inPin) {
+    size_t capacity = outPin->connectedTargets.capacity;
+    if(outPin->connectedTargets.count == capacity) {
+        ResizeTargets(outPin, capacity == 0 ? 1 : capacity*2);
+    }
+
+    inPin->source = outPin;
+    inPin->sourceIndex = outPin->connectedTargets.count;
+
+    outPin->connectedTargets.items[outPin->connectedTargets.count++] = inPin;
+    state.netlistVersion++;
+
+    if(outPin->connectedTargets.count == SIM_PULL_MIN_FANOUT) {
+        for(size_t i = 0; i < outPin->connectedTargets.count; i++) {
+            PullPin(outPin->connectedTargets.items[i], outPin->stateIndex);
+        }
+    } else if(outPin->connectedTargets.count > SIM_PULL_MIN_FANOUT) {
+        PullPin(inPin, outPin->stateIndex);
+    }
+}
+
+// O(1) thanks to SimPin.sourceIndex, the last target of the output pin
+// takes the place of the removed one
+static void DisconnectPin(SimPin *inPin) {
+    SimPin *outPin = inPin->source;
+    uint32_t index = inPin->sourceIndex;
+
+    assert(outPin != NULL && outPin->connectedTargets.items[index] == inPin);
+
+    ReleasePin(inPin);
+    da_remove_unordered(&outPin->connectedTargets, index);
+    if(index < outPin->connectedTargets.count) {
+        outPin->connectedTargets.items[index]->sourceIndex = index;
+    }
+
+    inPin->source = NULL;
+    state.netlistVersion++;
+}
+
+static void RemoveChipEvent(SimEventQueue *queue, SimChip *chip) {
+    for(size_t i = 0; i < queue->count; i++) {
+        if(queue->items[i]->parentChip == chip) {
+            da_remove_unordered(queue, i);
+            chip->scheduled = false;
+            return;
+        }
+    }
+}
+
+// the pins of a destroyed chip can't stay in the queues
+static void RemoveChipEvents(SimChip *chip) {
+    FinishStep();
+    if(!chip->scheduled) return;
+
+    RemoveChipEvent(&state.events, chip);
+
+    for(size_t i = 0; chip->scheduled && i < state.levelBuckets.count; i++) {
+        RemoveChipEvent(&state.levelBuckets.items[i], chip);
+        if(!chip->scheduled) state.levelEvents--;
+    }
+}
+
+void SimAddPinConnection(SimPin *outPin, SimPin *inPin) {
+    assert(!outPin->isInput && inPin->isInput);
+    assert(outPin->width == inPin->width && "The pins have different widths");
+
+    if(state.building) {
+        SimBuildConnect(outPin, inPin);
+        return;
+    }
+
+    assert(inPin->source == NULL && inPin->net == NULL && "The input pin is already connected");
+
+    ConnectPins(outPin, inPin);
+
+    if(UsesLevels() && !inPin->passive && !PatchLevels(outPin->parentChip, inPin->parentChip)) {
+        Relevelize();
+    }
+
+    SetPinState(inPin, GetPinState(outPin), GetPinUnknown(outPin));
+    AutoSettle();
+}
+
+void SimRemovePinConnection(SimPin *outPin, SimPin *inPin) {
+    assert(!state.building && "Connections can't be removed while building");
+    assert(!outPin->isInput && inPin->isInput);
+    assert(inPin->source == outPin && "The pins are not connected");
+
+    DisconnectPin(inPin);
+
+    // removing connections keeps the levels valid, nothing to patch
+
+    // an unconnected input is off
+    SetPinState(inPin, SIM_PIN_OFF, 0);
+    AutoSettle();
+}
+
+static SimNet *AllocNet(uint8_t width) {
+    SimNet *net = calloc(1, sizeof(SimNet));
+    assert(net != NULL && "No enough ram");
+
+    net->id = GenerateId();
+    net->index = state.nets.count;
+    net->width = width;
+    net->stateIndex = AllocStateSlot();
+
+    da_append(&state.nets, net);
+    state.netlistVersion++;
+
+    return net;
+}
+
+SimNet *SimNetCreate(uint8_t width) {
+    assert(width > 0 && width <= SIM_MAX_BUS_WIDTH && "Invalid bus width");
+
+    SimNet *net = AllocNet(width);
+
+    // without drivers the net is Z
+    if(state.fourState) state.pinUnknown.items[net->stateIndex] = GetWidthMask(width);
+
+    return net;
+}
+
+// the pin that tells if a tri-state buffer is driving has to update the net too
+static void SetDriverNet(SimPin *driver, SimNet *net, uint32_t index) {
+    driver->net = net;
+    driver->netIndex = index;
+
+    SimChip *chip = driver->parentChip;
+    if(chip->type == CHIP_TRISTATE && driver == &chip->outputs.items[0]) {
+        chip->outputs.items[1].net = net;
+        chip->outputs.items[1].netIndex = index;
+    }
+}
+
+// patches the levels for the connections between every driver and target,
+// or relevelizes if it's not possible
+static void PatchNetLevels(SimNet *net, SimPin *driver, SimPin *target) {
+    if(!UsesLevels()) return;
+
+    for(size_t i = 0; i < net->drivers.count; i++) {
+        if(driver != NULL && net->drivers.items[i] != driver) continue;
+
+        for(size_t j = 0; j < net->targets.count; j++) {
+            if(target != NULL && net->targets.items[j] != target) continue;
+            if(net->targets.items[j]->passive) continue;
+
+            if(!PatchLevels(net->drivers.items[i]->parentChip, net->targets.items[j]->parentChip)) {
+                Relevelize();
+                return;
+            }
+        }
+    }
+}
+
+void SimNetAddDriver(SimNet *net, SimPin *outPin) {
+    assert(!outPin->isInput);
+    assert(outPin->net == NULL && "The output pin already drives a net");
+    assert(outPin->width == net->width && "The pin and the net have different widths");
+
+    SimChip *chip = outPin->parentChip;
+    if(chip->type == CHIP_TRISTATE) {
+        assert(outPin == &chip->outputs.items[0] && "Only the first output of a tri-state buffer can drive a net");
+        assert(chip->outputs.items[1].net == NULL);
+    }
+
+    uint32_t index = net->drivers.count;
+    da_append(&net->drivers, outPin);
+    if(net->activeDrivers.count*64 < net->drivers.count) {
+        da_append(&net->activeDrivers, 0);
+    }
+
+    SetDriverNet(outPin, net, index);
+    UpdateNetDriver(net, index);
+    state.netlistVersion++;
+
+    PatchNetLevels(net, outPin, NULL);
+    if(!state.building) AutoSettle();
+}
+
+void SimNetAddTarget(SimNet *net, SimPin *inPin) {
+    assert(inPin->isInput);
+    assert(inPin->source == NULL && inPin->net == NULL && "The input pin is already connected");
+    assert(inPin->width == net->width && "The pin and the net have different widths");
+
+    inPin->net = net;
+    inPin->sourceIndex = net->targets.count;
+    da_append(&net->targets, inPin);
+    state.netlistVersion++;
+
+    if(net->targets.count == SIM_PULL_MIN_FANOUT) {
+        for(size_t i = 0; i < net->targets.count; i++) {
+            PullPin(net->targets.items[i], net->stateIndex);
+        }
+    } else if(net->targets.count > SIM_PULL_MIN_FANOUT) {
+        PullPin(inPin, net->stateIndex);
+    }
+
+    PatchNetLevels(net, NULL, inPin);
+
+    uint64_t unknown = state.fourState ? state.pinUnknown.items[net->stateIndex] : 0;
+    SetPinState(inPin, state.pinStates.items[net->stateIndex], unknown);
+    if(!state.building) AutoSettle();
+}
+
+// the last driver takes the place of the removed one, its bit too
+static void DetachNetDriver(SimPin *outPin) {
+    SimNet *net = outPin->net;
+    uint32_t index = outPin->netIndex;
+    uint32_t last = net->drivers.count - 1;
+
+    assert(net->drivers.items[index] == outPin);
+
+    uint64_t lastBit = (net->activeDrivers.items[last / 64] >> (last % 64)) & 1;
+    net->activeDrivers.items[last / 64] &= ~((uint64_t)1 << (last % 64));
+    net->activeDrivers.items[index / 64] &= ~((uint64_t)1 << (index % 64));
+    net->activeDrivers.items[index / 64] |= lastBit << (index % 64);
+
+    da_remove_unordered(&net->drivers, index);
+    if(index < net->drivers.count) SetDriverNet(net->drivers.items[index], net, index);
+
+    SetDriverNet(outPin, NULL, 0);
+
+    MarkNetDirty(net);
+    state.netlistVersion++;
+}
+
+static void DetachNetTarget(SimPin *inPin) {
+    SimNet *net = inPin->net;
+    uint32_t index = inPin->sourceIndex;
+
+    assert(net->targets.items[index] == inPin);
+
+    ReleasePin(inPin);
+    da_remove_unordered(&net->targets, index);
+    if(index < net->targets.count) net->targets.items[index]->sourceIndex = index;
+
+    inPin->net = NULL;
+    state.netlistVersion++;
+}
+
+void SimNetRemoveDriver(SimNet *net, SimPin *outPin) {
+    assert(!state.building && "Connections can't be removed while building");
+    assert(outPin->net == net && "The pin doesn't drive the net");
+
+    DetachNetDriver(outPin);
+    AutoSettle();
+}
+
+void SimNetRemoveTarget(SimNet *net, SimPin *inPin) {
+    assert(!state.building && "Connections can't be removed while building");
+    assert(inPin->net == net && "The pin isn't connected to the net");
+
+    DetachNetTarget(inPin);
+
+    SetPinState(inPin, SIM_PIN_OFF, 0);
+    AutoSettle();
+}
+
+void SimNetDestroy(SimNet *net) {
+    assert(!state.building && "Nets can't be destroyed while building");
+
+    for(size_t i = 0; i < net->targets.count; i++) {
+        SimPin *target = net->targets.items[i];
+        ReleasePin(target);
+        target->net = NULL;
+        SetPinState(target, SIM_PIN_OFF, 0);
+    }
+
+    for(size_t i = 0; i < net->drivers.count; i++) {
+        SetDriverNet(net->drivers.items[i], NULL, 0);
+    }
+
+    if(net->dirty) {
+        for(size_t i = 0; i < state.dirtyNets.count; i++) {
+            if(state.dirtyNets.items[i] == net) {
+                da_remove_unordered(&state.dirtyNets, i);
+                break;
+            }
+        }
+    }
+
+    // the last net takes the place of the removed one
+    size_t index = net->index;
+    da_remove_unordered(&state.nets, index);
+    if(index < state.nets.count) {
+        state.nets.items[index]->index = index;
+    }
+
+    da_append(&state.freePinStates, net->stateIndex);
+    da_free(&net->drivers);
+    da_free(&net->activeDrivers);
+    da_free(&net->targets);
+    free(net);
+    state.netlistVersion++;
+
+    AutoSettle();
+}
+
+uint64_t SimGetNetState(SimNet *net) {
+    return state.pinStates.items[net->stateIndex];
+}
+
+uint64_t SimGetNetUnknown(SimNet *net) {
+    return state.fourState ? state.pinUnknown.items[net->stateIndex] : 0;
+}
+
+void SimDestroyChip(SimChip *chip) {
+    assert(!state.building && "Chips can't be destroyed while building");
+
+    RemoveChipEvents(chip);
+
+    for(size_t i = 0; i < chip->inputs.count; i++) {
+        if(chip->inputs.items[i].source != NULL) DisconnectPin(&chip->inputs.items[i]);
+        if(chip->inputs.items[i].net != NULL) DetachNetTarget(&chip->inputs.items[i]);
+    }
+
+    for(size_t i = 0; i < chip->outputs.count; i++) {
+        SimPin *out = &chip->outputs.items[i];
+
+        // the pin that tells if a tri-state buffer is driving goes with the first one
+        if(out->net != NULL) DetachNetDriver(out);
+
+        for(size_t j = 0; j < out->connectedTargets.count; j++) {
+            SimPin *target = out->connectedTargets.items[j];
+            ReleasePin(target);
+            target->source = NULL;
+            SetPinState(target, SIM_PIN_OFF, 0);
+        }
+
+        ReleaseTargets(out);
+    }
+
+    FreePinArr(chip->inputs);
+    FreePinArr(chip->outputs);
+
+    if(chip->type == CHIP_DFF) da_append(&state.freePinStates, chip->stateIndex);
+
+    // the last chip takes the place of the removed one
+    size_t index = chip->index;
+    da_remove_unordered(&state.chips, index);
+    if(index < state.chips.count) {
+        state.chips.items[index]->index = index;
+    }
+
+    PushFreeBlock(&state.freeChips, chip);
+    state.netlistVersion++;
+
+    AutoSettle();
+}
+
+void SimBuildBegin(void) {
+    assert(!state.building && "SimBuildBegin called twice");
+    state.building = true;
+}
+
+void SimBuildConnect(SimPin *outPin, SimPin *inPin) {
+    assert(state.building && "SimBuildConnect called outside of SimBuildBegin/SimBuildEnd");
+    assert(!outPin->isInput && inPin->isInput);
+    assert(outPin->width == inPin->width && "The pins have different widths");
+
+    SimConnection conn = {
+        .outPin = outPin,
+        .inPin = inPin,
+    };
+    da_append(&state.buildConnections, conn);
+}
+
+static int CompareConnections(const void *a, const void *b) {
+    uintptr_t outA = (uintptr_t)((const SimConnection*)a)->outPin;
+    uintptr_t outB = (uintptr_t)((const SimConnection*)b)->outPin;
+    return (outA > outB) - (outA < outB);
+}
+
+// the clocks seen by the flip-flops at the end of a build aren't edges
+static void SyncFlipFlopClocks(void) {
+    for(size_t i = 0; i < state.chips.count; i++) {
+        SimChip *chip = state.chips.items[i];
+        if(chip->type != CHIP_DFF) continue;
+
+        SimPin *clock = &chip->inputs.items[1];
+        state.pinStates.items[chip->stateIndex] = GetPinState(clock);
+        if(state.fourState) state.pinUnknown.items[chip->stateIndex] = GetPinUnknown(clock);
+    }
+}
+
+void SimBuildEnd(void) {
+    assert(state.building && "SimBuildEnd called without SimBuildBegin");
+
+    // group the connections by output pin so each fan-out array is resized only once
+    qsort(state.buildConnections.items, state.buildConnections.count, sizeof(SimConnection), CompareConnections);
+
+    size_t i = 0;
+    while(i < state.buildConnections.count) {
+        SimPin *outPin = state.buildConnections.items[i].outPin;
+
+        size_t end = i;
+        while(end < state.buildConnections.count && state.buildConnections.items[end].outPin == outPin) {
+            end++;
+        }
+
+        size_t needed = outPin->connectedTargets.count + (end - i);
+        if(needed > outPin->connectedTargets.capacity) {
+            ResizeTargets(outPin, needed);
+        }
+
+        for(; i < end; i++) {
+            SimPin *inPin = state.buildConnections.items[i].inPin;
+            assert(inPin->source == NULL && inPin->net == NULL && "The input pin is already connected");
+
+            ConnectPins(outPin, inPin);
+            SetPinState(inPin, GetPinState(outPin), GetPinUnknown(outPin));
+        }
+    }
+
+    da_free(&state.buildConnections);
+    state.buildConnections.items = NULL;
+    state.buildConnections.count = 0;
+    state.buildConnections.capacity = 0;
+
+    state.netlistVersion++;
+
+    EvaluateInTopologicalOrder();
+    SyncFlipFlopClocks();
+
+    state.building = false;
+    if(state.engine == SIM_ENGINE_LEVELIZED) Relevelize();
+
+    AutoSettle();
+}
+
+bool SimStep(void) {
+    if(!state.stepping && !BeginStep()) return false;
+
+    FinishStep();
+
+    return HasEvents();
+}
+
+static uint64_t GetMicroseconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec*1000000 + time.tv_nsec/1000;
+}
+
+bool SimRun(uint64_t maxMicroseconds, size_t maxEvents) {
+    uint64_t start = maxMicroseconds > 0 ? GetMicroseconds() : 0;
+    size_t evaluated = 0;
+    state.watch.stopped = false;
+
+    // a step is only started if it's going to evaluate something, so the
+    // number of evaluated events tells exactly where the simulation stopped
+    while(!(maxEvents > 0 && evaluated >= maxEvents)) {
+        if(!state.stepping && !BeginStep()) break;
+
+        size_t chunk = SIM_RUN_CHECK_EVENTS;
+        if(maxEvents > 0 && maxEvents - evaluated < chunk) chunk = maxEvents - evaluated;
+
+        evaluated += ContinueStep(chunk);
+
+        if(state.watch.stopped) break;
+        if(maxMicroseconds > 0 && GetMicroseconds() - start >= maxMicroseconds) break;
+    }
+
+    return IsSettled();
+}
+
+uint64_t SimGetStepCount(void) {
+    return state.stepCount;
+}
+
+uint64_t SimGetEventCount(void) {
+    return state.eventCount;
+}
+
+void SimSetStimulusHook(SimStimulusHook hook) {
+    state.stimulusHook = hook;
+}
+
+void SimSetCycleHook(SimCycleHook hook) {
+    state.cycleHook = hook;
+}
+
+bool SimSettle(void) {
+    ResolveNets();
+    if(!state.stepping && !HasEvents() && !IsConeOutdated()) return true;
+
+    // a circuit without loops can't take more steps than its number of chips
+    size_t maxSteps = SIM_MAX_SETTLE_STEPS;
+    if(state.chips.count > maxSteps) maxSteps = state.chips.count;
+
+    state.watch.stopped = false;
+
+    for(size_t i = 0; i < maxSteps; i++) {
+        if(!SimStep()) return true;
+        if(state.watch.stopped) return false;
+    }
+
+    log_error("The circuit didn't settle after %lu steps", maxSteps);
+    return false;
+}
+
+// the only output pin driving the input, NULL if it has none or many
+static SimPin *GetOnlyDriver(SimPin *pin) {
+    if(pin->source != NULL) return pin->source;
+    if(pin->net != NULL && pin->net->drivers.count == 1) return pin->net->drivers.items[0];
+    return NULL;
+}
+
+// Splits the chips into the flip-flops and the rest of the evaluated chips
+// in topological order. Returns false if the circuit isn't synchronous
+static bool PlanCycles(void) {
+    if(state.cycle.planned && state.cycle.netlistVersion == state.netlistVersion) return true;
+
+    state.cycle.planned = false;
+    state.cycle.order.count = 0;
+    state.cycle.flipFlops.count = 0;
+
+    if(state.cycle.order.capacity < state.chips.count) {
+        state.cycle.order.capacity = state.chips.count;
+        state.cycle.order.items = realloc(state.cycle.order.items, state.cycle.order.capacity*sizeof(SimChip*));
+        assert(state.cycle.order.items != NULL && "No enough ram");
+    }
+
+    SimChip **order = state.cycle.order.items;
+    size_t sorted = SortTopologically(order);
+
+    if(sorted < state.chips.count) {
+        log_error("The cycle based simulation can't simulate circuits with combinational loops");
+        return false;
+    }
+
+    SimPin *clock = NULL;
+
+    for(size_t i = 0; i < sorted; i++) {
+        SimChip *chip = order[i];
+
+        if(chip->type == CHIP_LATCH) {
+            log_error("The cycle based simulation needs every state element to be a flip-flop");
+            return false;
+        }
+
+        if(chip->type != CHIP_DFF) {
+            if(IsEvaluated(chip)) order[state.cycle.order.count++] = chip;
+            continue;
+        }
+
+        SimPin *driver = GetOnlyDriver(&chip->inputs.items[1]);
+        if(clock == NULL) clock = driver;
+
+        if(driver == NULL || driver != clock || driver->parentChip->type != CHIP_INPUT) {
+            log_error("The cycle based simulation needs every flip-flop to be clocked by the same input");
+            return false;
+        }
+
+        da_append(&state.cycle.flipFlops, chip);
+    }
+
+    // the clock doesn't change during the cycles, the logic can't see it
+    for(size_t i = 0; clock != NULL && i < SimGetFanOutCount(clock); i++) {
+        SimPin *target = SimGetFanOutTarget(clock, i);
+
+        if(target->parentChip->type != CHIP_DFF || target != &target->parentChip->inputs.items[1]) {
+            log_error("The cycle based simulation needs a clock that only drives flip-flops");
+            return false;
+        }
+    }
+
+    state.cycle.planned = true;
+    state.cycle.netlistVersion = state.netlistVersion;
+    state.cycle.clock = clock;
+
+    return true;
+}
+
+// Every flip-flop takes its data at once and the logic that changed is
+// evaluated once in topological order. It's a step for the history
+static void RunCycle(void) {
+    if(state.history.enabled) {
+        RecordStepStart();
+        LogWrite(SIM_LOG_STEP, NULL, 0, state.stepCount, SIM_LOG_ALL_LEVELS);
+        TrimHistory();
+    }
+
+    for(size_t i = 0; i < state.cycle.flipFlops.count; i++) {
+        SimChip *dff = state.cycle.flipFlops.items[i];
+
+        if(state.fourState) {
+            SimPlanes data = GetInputPlanes(dff, 0);
+            DrivePlanes(dff, 0, data.value & 1, data.unknown & 1);
+        } else {
+            DriveOutput(dff, 0, GetInputState(dff, 0));
+        }
+    }
+
+    ApplyUpdates(&state.clockedUpdates);
+    ResolveNets();
+    state.eventCount += state.cycle.flipFlops.count;
+
+    for(size_t i = 0; i < state.cycle.order.count; i++) {
+        SimChip *chip = state.cycle.order.items[i];
+        if(!chip->scheduled) continue;
+
+        chip->scheduled = false;
+        EvaluateChip(chip);
+        ApplyUpdates(&state.updates);
+        ResolveNets();
+        state.eventCount++;
+    }
+
+    state.stepCount++;
+}
+
+size_t SimRunCycles(size_t cycles) {
+    if(state.demand.enabled) {
+        log_error("The cycle based simulation can't run in the demand driven mode");
+        return 0;
+    }
+
+    if(!SimSettle() || !PlanCycles()) return 0;
+
+    if(state.cycle.clock != NULL && GetPinUnknown(state.cycle.clock) & 1) {
+        log_error("The clock of the cycle based simulation is unknown");
+        return 0;
+    }
+
+    size_t done = 0;
+    state.watch.stopped = false;
+    state.cycle.running = true;
+
+    while(done < cycles) {
+        if(state.cycleHook != NULL) state.cycleHook();
+
+        RunCycle();
+        done++;
+
+        if(state.watch.stopped) break;
+    }
+
+    state.cycle.running = false;
+
+    return done;
+}
+
+bool SimSetEngine(SimEngine engine) {
+    assert(!state.building && "The engine can't be changed while building");
+
+    if(engine == SIM_ENGINE_LEVELIZED && !LevelizeAll()) {
+        log_error("The levelized engine can't simulate circuits with loops");
+        return false;
+    }
+
+    state.engine = engine;
+    RequeueEvents();
+
+    return true;
+}
+
+SimEngine SimGetEngine(void) {
+    return state.engine;
+}
+
+void SimSetAutoSettle(bool enabled) {
+    state.manualSettle = !enabled;
+}
+
+bool SimGetAutoSettle(void) {
+    return !state.manualSettle;
+}
+
+uint64_t SimGetPinState(SimPin *pin) {
+    return GetPinState(pin);
+}
+
+void SimSetFourState(bool enabled) {
+    assert(!state.building && "The logic mode can't be changed while building");
+    if(enabled == state.fourState) return;
+
+    FinishStep();
+
+    state.fourState = enabled;
+
+    if(enabled) {
+        // every pin starts known
+        da_init(&state.pinUnknown, state.pinStates.count > 0 ? state.pinStates.count : 1);
+        bzero(state.pinUnknown.items, state.pinStates.count*sizeof(uint64_t));
+        state.pinUnknown.count = state.pinStates.count;
+        return;
+    }
+
+    da_free(&state.pinUnknown);
+    state.pinUnknown.items = NULL;
+    state.pinUnknown.count = 0;
+    state.pinUnknown.capacity = 0;
+
+    // X and Z became plain 1 and 0, the outputs have to be computed again
+    for(size_t i = 0; i < state.chips.count; i++) {
+        SimChip *chip = state.chips.items[i];
+        if(chip->inputs.count > 0) ScheduleChip(&chip->inputs.items[0]);
+    }
+
+    AutoSettle();
+}
+
+bool SimGetFourState(void) {
+    return state.fourState;
+}
+
+uint64_t SimGetPinUnknown(SimPin *pin) {
+    return GetPinUnknown(pin);
+}
+
+char SimGetPinBit(SimPin *pin, size_t bit) {
+    assert(bit < pin->width);
+
+    uint64_t value = (GetPinState(pin) >> bit) & 1;
+    uint64_t unknown = (GetPinUnknown(pin) >> bit) & 1;
+
+    if(unknown) return value ? 'X' : 'Z';
+    return value ? '1' : '0';
+}
+
+SimStateSnapshot *SimSnapshot(void) {
+    FinishStep();
+    // the edits made without settling can leave nets to resolve, the
+    // restore only keeps the resolved state
+    ResolveNets();
+
+    // the levelized engine keeps its events in buckets, putting them
+    // together in state.events makes the copy a single memcpy
+    if(state.levelEvents > 0) {
+        SimEngine engine = state.engine;
+        state.engine = SIM_ENGINE_EVENT;
+        RequeueEvents();
+        state.engine = engine;
+    }
+
+    size_t eventsSize = state.events.count*sizeof(SimPin*);
+    size_t forcedSize = state.forcedPins.count*sizeof(SimPin*);
+    size_t pinsSize = state.pinStates.count*sizeof(uint64_t);
+    size_t unknownSize = state.fourState ? pinsSize : 0;
+
+    // everything goes in a single allocation
+    SimStateSnapshot *snapshot = malloc(sizeof(SimStateSnapshot) + eventsSize + forcedSize + pinsSize + unknownSize);
+    assert(snapshot != NULL && "No enough ram");
+
+    snapshot->netlistVersion = state.netlistVersion;
+    snapshot->coneVersion = GetConeVersion();
+    snapshot->eventCount = state.events.count;
+    snapshot->events = (SimPin**)(snapshot + 1);
+    snapshot->forcedCount = state.forcedPins.count;
+    snapshot->forcedPins = snapshot->events + snapshot->eventCount;
+    snapshot->pinCount = state.pinStates.count;
+    snapshot->pinStates = (uint64_t*)(snapshot->forcedPins + snapshot->forcedCount);
+
+    if(eventsSize > 0) memcpy(snapshot->events, state.events.items, eventsSize);
+    if(forcedSize > 0) memcpy(snapshot->forcedPins, state.forcedPins.items, forcedSize);
+    if(pinsSize > 0) memcpy(snapshot->pinStates, state.pinStates.items, pinsSize);
+
+    snapshot->pinUnknown = NULL;
+    if(state.fourState) {
+        snapshot->pinUnknown = snapshot->pinStates + snapshot->pinCount;
+        if(unknownSize > 0) memcpy(snapshot->pinUnknown, state.pinUnknown.items, unknownSize);
+    }
+
+    if(UsesLevels()) RequeueEvents();
+
+    return snapshot;
+}
+
+// the active drivers come from the pins, the values of the nets are
+// already in their slots
+static void SyncNets(void) {
+    for(size_t i = 0; i < state.nets.count; i++) {
+        SimNet *net = state.nets.items[i];
+
+        for(size_t j = 0; j < net->drivers.count; j++) {
+            UpdateNetDriver(net, j);
+        }
+
+        net->dirty = false;
+    }
+    state.dirtyNets.count = 0;
+}
+
+static void RestoreState(SimStateSnapshot *snapshot) {
+    // the current events are dropped
+    SimEngine engine = state.engine;
+    state.engine = SIM_ENGINE_EVENT;
+    RequeueEvents();
+    state.engine = engine;
+
+    for(size_t i = 0; i < state.events.count; i++) {
+        state.events.items[i]->parentChip->scheduled = false;
+    }
+
+    state.events.count = 0;
+    if(snapshot->eventCount > 0) {
+        da_append_many(&state.events, snapshot->events, snapshot->eventCount);
+    }
+
+    for(size_t i = 0; i < state.events.count; i++) {
+        state.events.items[i]->parentChip->scheduled = true;
+    }
+
+    if(snapshot->pinCount > 0) {
+        memcpy(state.pinStates.items, snapshot->pinStates, snapshot->pinCount*sizeof(uint64_t));
+
+        // a snapshot taken in two state mode only has known bits
+        if(snapshot->pinUnknown != NULL) {
+            memcpy(state.pinUnknown.items, snapshot->pinUnknown, snapshot->pinCount*sizeof(uint64_t));
+        } else if(state.fourState) {
+            bzero(state.pinUnknown.items, snapshot->pinCount*sizeof(uint64_t));
+        }
+    }
+
+    // the same netlist only differs in the forced pins
+    for(size_t i = 0; i < state.forcedPins.count; i++) {
+        SimPin *pin = state.forcedPins.items[i];
+        pin->readIndex = pin->source != NULL ? pin->source->stateIndex : pin->net->stateIndex;
+        pin->pulled = true;
+        pin->forced = false;
+    }
+
+    state.forcedPins.count = 0;
+    for(size_t i = 0; i < snapshot->forcedCount; i++) {
+        SimPin *pin = snapshot->forcedPins[i];
+        pin->readIndex = pin->stateIndex;
+        pin->pulled = false;
+        AddForcedPin(pin);
+    }
+
+    if(state.watch.slots.count > 0) RebuildWatchSlots();
+
+    SyncNets();
+
+    // which chips were stale when the snapshot was taken is only known
+    // while the cone is the same
+    if(snapshot->coneVersion != 0) InvalidateChips(snapshot->coneVersion != GetConeVersion());
+
+    if(UsesLevels()) RequeueEvents();
+}
+
+bool SimRestore(SimStateSnapshot *snapshot) {
+    FinishStep();
+
+    if(snapshot->netlistVersion != state.netlistVersion) {
+        log_error("The snapshot was taken from a different circuit (version %lu, current %lu)",
+            snapshot->netlistVersion, state.netlistVersion);
+        return false;
+    }
+
+    if(snapshot->pinUnknown != NULL && !state.fourState) {
+        log_error("The snapshot was taken in four state mode");
+        return false;
+    }
+
+    assert(snapshot->pinCount == state.pinStates.count);
+
+    RestoreState(snapshot);
+
+    // the history doesn't know how the circuit got here
+    if(state.history.enabled) HistoryRestart();
+
+    return true;
+}
+
+void SimSnapshotFree(SimStateSnapshot *snapshot) {
+    free(snapshot);
+}
+
+void SimHistoryEnable(size_t maxBytes, size_t interval) {
+    assert(!state.building && "The history can't be enabled while building");
+
+    FinishStep();
+    ResolveNets();
+
+    state.history.enabled = false;
+    state.history.maxBytes = maxBytes;
+    state.history.interval = interval;
+    HistoryRestart();
+    state.history.enabled = true;
+}
+
+void SimHistoryDisable(void) {
+    HistoryClear();
+    da_free(&state.history.checkpoints);
+
+    state.history.checkpoints.items = NULL;
+    state.history.checkpoints.capacity = 0;
+    state.history.enabled = false;
+}
+
+uint64_t SimHistoryGetOldestStep(void) {
+    if(!state.history.enabled) return state.stepCount;
+    return state.history.checkpoints.items[0].step;
+}
+
+// drops the events taken by a step while replaying its log
+static void DropStepEvents(uint64_t level) {
+    SimEventQueue *queue = &state.events;
+
+    if(level != SIM_LOG_ALL_LEVELS) {
+        assert(level < state.levelBuckets.count);
+        queue = &state.levelBuckets.items[level];
+        state.levelEvents -= queue->count;
+    }
+
+    for(size_t i = 0; i < queue->count; i++) {
+        queue->items[i]->parentChip->scheduled = false;
+    }
+
+    queue->count = 0;
+}
+
+bool SimHistoryGoTo(uint64_t step) {
+    if(!state.history.enabled) return false;
+
+    FinishStep();
+
+    if(IsHistoryOutdated()) {
+        HistoryRestart();
+        return false;
+    }
+
+    if(step == state.stepCount) return true;
+    if(step > state.stepCount || step < SimHistoryGetOldestStep()) return false;
+
+    size_t index = state.history.checkpoints.count - 1;
+    while(state.history.checkpoints.items[index].step > step) index--;
+
+    for(size_t i = index + 1; i < state.history.checkpoints.count; i++) {
+        FreeCheckpoint(&state.history.checkpoints.items[i]);
+    }
+    state.history.checkpoints.count = index + 1;
+
+    SimCheckpoint *checkpoint = &state.history.checkpoints.items[index];
+
+    // the writes made while replaying are already in the log, and they
+    // don't trigger the watches or count as activity again
+    state.history.enabled = false;
+    size_t watchedWords = state.watch.slots.count;
+    state.watch.slots.count = 0;
+    bool activity = state.activity.enabled;
+    state.activity.enabled = false;
+
+    RestoreState(checkpoint->snapshot);
+
+    size_t i = 0;
+    for(; i < checkpoint->log.count; i++) {
+        SimLogEntry entry = checkpoint->log.items[i];
+        if(entry.kind == SIM_LOG_STEP && entry.value == step) break;
+
+        switch(entry.kind) {
+            case SIM_LOG_PIN:
+                PropagatePinState(entry.target, entry.value, entry.unknown);
+                break;
+            case SIM_LOG_NET:
+                SetNetState(entry.target, entry.value, entry.unknown);
+                break;
+            case SIM_LOG_SLOT:
+                state.pinStates.items[entry.slot] = entry.value;
+                if(state.fourState) state.pinUnknown.items[entry.slot] = entry.unknown;
+                break;
+            case SIM_LOG_STEP:
+                DropStepEvents(entry.unknown);
+                break;
+        }
+    }
+
+    assert(i < checkpoint->log.count && "The step isn't in the log");
+
+    state.history.usedBytes -= (checkpoint->log.count - i)*sizeof(SimLogEntry);
+    checkpoint->log.count = i;
+
+    SyncNets();
+    state.stepCount = step;
+    state.history.enabled = true;
+    state.watch.slots.count = watchedWords;
+    state.activity.enabled = activity;
+    // the replay may have pulled or forced watched pins
+    if(state.watch.slots.count > 0) RebuildWatchSlots();
+
+    return true;
+}
+
+bool SimHistoryStepBack(void) {
+    return state.stepCount > 0 && SimHistoryGoTo(state.stepCount - 1);
+}
+
+uint32_t SimWatchAdd(SimPin *pin, SimWatchKind kind, uint64_t mask, uint64_t value) {
+    uint64_t widthMask = GetWidthMask(pin->width);
+    SimWatch watch = {++state.watch.nextId, pin, kind, mask & widthMask, value & mask & widthMask};
+    da_append(&state.watch.watches, watch);
+
+    SetWatchSlot(pin->readIndex);
+    state.demand.dirty = true;
+
+    return watch.id;
+}
+
+void SimWatchRemove(uint32_t id) {
+    for(size_t i = 0; i < state.watch.watches.count; i++) {
+        if(state.watch.watches.items[i].id == id) {
+            RemoveWatch(i);
+            return;
+        }
+    }
+}
+
+bool SimWatchStopped(void) {
+    return state.watch.stopped;
+}
+
+size_t SimWatchGetHitCount(void) {
+    return state.watch.hits.count;
+}
+
+const SimWatchHit *SimWatchGetHit(size_t index) {
+    assert(index < state.watch.hits.count);
+    return &state.watch.hits.items[index];
+}
+
+void SimWatchClearHits(void) {
+    state.watch.hits.count = 0;
+}
+
+void SimCoverageEnable(void) {
+    state.coverage.enabled = true;
+
+    // the words are appended again as zeros
+    state.coverage.rise.count = 0;
+    state.coverage.fall.count = 0;
+    if(state.pinStates.count > 0) ResetSlotCoverage(state.pinStates.count - 1);
+}
+
+void SimCoverageDisable(void) {
+    da_free(&state.coverage.rise);
+    da_free(&state.coverage.fall);
+    bzero(&state.coverage, sizeof(state.coverage));
+}
+
+bool SimCoverageIsEnabled(void) {
+    return state.coverage.enabled;
+}
+
+uint8_t SimCoverageGetPin(SimPin *pin) {
+    if(!state.coverage.enabled) return 0;
+
+    uint32_t slot = pin->readIndex;
+    uint8_t toggles = 0;
+
+    if((state.coverage.rise.items[slot/64] >> (slot % 64)) & 1) toggles |= SIM_TOGGLE_RISE;
+    if((state.coverage.fall.items[slot/64] >> (slot % 64)) & 1) toggles |= SIM_TOGGLE_FALL;
+
+    return toggles;
+}
+
+void SimCoverageMarkPin(SimPin *pin, uint8_t toggles) {
+    assert(state.coverage.enabled && "The coverage isn't enabled");
+
+    uint32_t slot = pin->readIndex;
+    uint64_t bit = (uint64_t)1 << (slot % 64);
+
+    if(toggles & SIM_TOGGLE_RISE) state.coverage.rise.items[slot/64] |= bit;
+    if(toggles & SIM_TOGGLE_FALL) state.coverage.fall.items[slot/64] |= bit;
+}
+
+void SimActivityEnable(void) {
+    state.activity.enabled = true;
+
+    state.activity.toggles.count = 0;
+    if(state.pinStates.count > 0) ResetSlotActivity(state.pinStates.count - 1);
+}
+
+void SimActivityDisable(void) {
+    da_free(&state.activity.toggles);
+    bzero(&state.activity, sizeof(state.activity));
+}
+
+bool SimActivityIsEnabled(void) {
+    return state.activity.enabled;
+}
+
+uint64_t SimActivityGetPin(SimPin *pin) {
+    if(!state.activity.enabled) return 0;
+    return state.activity.toggles.items[pin->stateIndex];
+}
+
+void SimDemandEnable(void) {
+    assert(!state.building && "The demand driven mode can't be enabled while building");
+
+    state.demand.enabled = true;
+    state.demand.dirty = true;
+    UpdateCone();
+}
+
+void SimDemandDisable(void) {
+    if(!state.demand.enabled) return;
+
+    state.demand.enabled = false;
+
+    for(size_t i = 0; i < state.chips.count; i++) {
+        SimChip *chip = state.chips.items[i];
+
+        if(chip->stale) {
+            chip->stale = false;
+            ScheduleChip(&chip->inputs.items[0]);
+        }
+    }
+
+    if(!state.building) AutoSettle();
+}
+
+bool SimDemandIsEnabled(void) {
+    return state.demand.enabled;
+}
+
+size_t SimDemandGetConeSize(void) {
+    UpdateCone();
+    return state.demand.coneSize;
+}
+
+void SimProbeAdd(SimPin *pin) {
+    da_append(&state.demand.probes, pin);
+    state.demand.dirty = true;
+}
+
+void SimProbeRemove(SimPin *pin) {
+    for(size_t i = 0; i < state.demand.probes.count; i++) {
+        if(state.demand.probes.items[i] == pin) {
+            RemoveProbe(i);
+            return;
+        }
+    }
+}
+
+size_t SimGetChipCount(void) {
+    return state.chips.count;
+}
+
+SimChip *SimGetChip(size_t index) {
+    assert(index < state.chips.count);
+    return state.chips.items[index];
+}
+
+size_t SimSortTopologically(SimChip **order) {
+    return SortTopologically(order);
+}
+
+size_t SimGetStateSlotCount(void) {
+    return state.pinStates.count;
+}
+
+void SimCopyPinStates(uint64_t *states, uint64_t *unknown) {
+    size_t count = state.pinStates.count;
+    memcpy(states, state.pinStates.items, count*sizeof(uint64_t));
+
+    if(unknown != NULL) {
+        if(state.fourState) {
+            memcpy(unknown, state.pinUnknown.items, count*sizeof(uint64_t));
+        } else {
+            memset(unknown, 0, count*sizeof(uint64_t));
+        }
+    }
+
+    // the own slot of a pulled pin is stale, the copy gets the state it reads
+    for(size_t i = 0; i < state.chips.count; i++) {
+        SimPinArr inputs = state.chips.items[i]->inputs;
+
+        for(size_t j = 0; j < inputs.count; j++) {
+            SimPin *pin = &inputs.items[j];
+            if(!pin->pulled) continue;
+
+            states[pin->stateIndex] = states[pin->readIndex];
+            if(unknown != NULL) unknown[pin->stateIndex] = unknown[pin->readIndex];
+        }
+    }
+}
+
+const char *SimGetChipTypeName(ChipType type) {
+    switch(type) {
+        case CHIP_NAND: return "NAND";
+        case CHIP_AND: return "AND";
+        case CHIP_OR: return "OR";
+        case CHIP_XOR: return "XOR";
+        case CHIP_NOT: return "NOT";
+        case CHIP_MUX: return "MUX";
+        case CHIP_FULL_ADDER: return "FULL_ADDER";
+        case CHIP_DFF: return "DFF";
+        case CHIP_LATCH: return "LATCH";
+        case CHIP_BUS_AND: return "BUS_AND";
+        case CHIP_BUS_OR: return "BUS_OR";
+        case CHIP_BUS_XOR: return "BUS_XOR";
+        case CHIP_BUS_ADD: return "BUS_ADD";
+        case CHIP_BUS_MUX: return "BUS_MUX";
+        case CHIP_BUS_SPLIT: return "BUS_SPLIT";
+        case CHIP_BUS_JOIN: return "BUS_JOIN";
+        case CHIP_TRISTATE: return "TRISTATE";
+        case CHIP_LED: return "LED";
+        case CHIP_INPUT: return "INPUT";
+    }
+
+    return "UNKNOWN";
+}
+
+static void PrintPin(size_t index, SimPin *pin) {
+    if(!state.fourState) {
+        printf("    [%lu] = %lu\n", index, GetPinState(pin));
+        return;
+    }
+
+    // most significant bit first
+    printf("    [%lu] = ", index);
+    for(size_t i = pin->width; i > 0; i--) {
+        putchar(SimGetPinBit(pin, i - 1));
+    }
+    printf("\n");
+}
+
+void SimPrintChip(SimChip *chip) {
+    const char *chipName = SimGetChipTypeName(chip->type);
+
+    printf("[%s] (#%u) {\n", chipName, chip->id);
+
+    printf("  [Inputs] {\n");
+    for(size_t i = 0; i < chip->inputs.count; i++) {
+        PrintPin(i, &chip->inputs.items[i]);
+    }
+    printf("  }\n");
+
+    printf("  [Ouputs] {\n");
+    for(size_t i = 0; i < chip->outputs.count; i++) {
+        PrintPin(i, &chip->outputs.items[i]);
+    }
+    printf("  }\n");
+
+    printf("}\n");
+}
+
+void SimDestroy(void) {
+    // chips, pins and fan-out arrays all live in the arena
+    if(state.arena != NULL) arena_free(state.arena);
+
+    for(size_t i = 0; i < state.nets.count; i++) {
+        SimNet *net = state.nets.items[i];
+        da_free(&net->drivers);
+        da_free(&net->activeDrivers);
+        da_free(&net->targets);
+        free(net);
+    }
+
+    da_free(&state.chips);
+    da_free(&state.nets);
+    da_free(&state.dirtyNets);
+    da_free(&state.events);
+    da_free(&state.processing);
+    da_free(&state.grouped);
+    da_free(&state.updates);
+    da_free(&state.clockedUpdates);
+    da_free(&state.buildConnections);
+    da_free(&state.pinStates);
+    da_free(&state.pinUnknown);
+    da_free(&state.freePinStates);
+    da_free(&state.forcedPins);
+    for(size_t i = 0; i < state.levelBuckets.count; i++) {
+        da_free(&state.levelBuckets.items[i]);
+    }
+    da_free(&state.levelBuckets);
+    da_free(&state.levelStack);
+    da_free(&state.watch.watches);
+    da_free(&state.watch.slots);
+    da_free(&state.watch.hits);
+    da_free(&state.demand.probes);
+    da_free(&state.demand.stack);
+    da_free(&state.cycle.order);
+    da_free(&state.cycle.flipFlops);
+    SimCoverageDisable();
+    SimActivityDisable();
+    SimHistoryDisable();
+
+    state = (SimState){0};
 }
 
 // TODO: it could be a good idea to remove all asserts and instead print an error message
@@ -7,8 +7,20 @@
 
 #include "types.h"
 
+// min number of steps SimSettle will run before giving up (e.g. oscillating circuits)
+#define SIM_MAX_SETTLE_STEPS 100000
+
+#define SIM_MAX_BUS_WIDTH 64
+
+// fan-out from which the targets of an output pin or a net are pulled, see
+// SimPin.pulled. They stay pulled while they're connected, except for a
+// while after being set from outside
+#define SIM_PULL_MIN_FANOUT 32
+
 typedef struct SimPin SimPin;
 typedef struct SimChip SimChip;
+typedef struct SimNet SimNet;
+typedef struct SimStateSnapshot SimStateSnapshot;
 
 // this is a static array since "capacity" doesn't exist, needed for
 // dynamic arrays
@@ -22,41 +34,373 @@ enum {
     SIM_PIN_ON,
 };
 
-typedef void (*SimPinOnChange)(SimChip*);
+typedef enum {
+    // every step evaluates the chips whose inputs changed in the previous one
+    SIM_ENGINE_EVENT,
+    // every chip gets a level higher than the chips driving it and each step
+    // evaluates one level, so a chip is evaluated at most once per settle.
+    // Only works on circuits without loops, the flip-flops cut them.
+    SIM_ENGINE_LEVELIZED,
+} SimEngine;
 
 struct SimPin {
     bool isInput;
+    uint8_t width; // number of bits, 1 for normal pins and up to SIM_MAX_BUS_WIDTH for buses
     SimChip *parentChip;
-    uint8_t state;
-
-    // function that will be called on input pins when they are called.
-    // Will be used by the chips to update themselves.
-    SimPinOnChange onChange;
+    uint32_t stateIndex; // use SimGetPinState to read the state of the pin
+    // slot the state is read from: stateIndex, or the slot of the driver for
+    // the pulled input pins
+    uint32_t readIndex;
+    // the input pin reads the slot of its driver (an output pin or a net with
+    // at least SIM_PULL_MIN_FANOUT targets) instead of getting a copy of
+    // every change, so a change of the driver is a single write. Setting the
+    // pin from outside gives it its own slot back until the driver changes
+    bool pulled;
+    // set from outside while pulled, the pin is at "forcedIndex" in the
+    // forced pins of the simulation until it's pulled again
+    bool forced;
+    uint32_t forcedIndex;
+    // changes of the input pin don't schedule its chip (the data input of a
+    // flip-flop is only read on the clock edge)
+    bool passive;
 
     struct {
         SimPin **items;
         size_t count;
         size_t capacity;
     } connectedTargets; // for output pin
+
+    // for input pins: the output pin connected to it and the position of this
+    // pin in its connectedTargets (or in the targets of its net), so removing
+    // the connection doesn't need a search
+    SimPin *source;
+    uint32_t sourceIndex;
+    // position in the drivers of the net, for output pins
+    uint32_t netIndex;
+    // the net the pin drives or is fed by
+    SimNet *net;
 };
 
 struct SimChip {
-    uint16_t id;
+    uint32_t id;
+    uint32_t index; // position in the chips of the simulation
     ChipType type;
+    // slot with the internal state of the sequential chips (CHIP_DFF)
+    uint32_t stateIndex;
     SimPinArr inputs;
     SimPinArr outputs;
+
+    // the chip is already waiting in the event queue
+    bool scheduled;
+    // demand driven mode: the chip is in the cone of influence of the
+    // observed pins, or an input changed while it was out of it
+    bool observed;
+    bool stale;
+
+    uint32_t level; // only kept up to date by the levelized engine
+};
+
+// A net connects several output pins (the drivers) to several input pins.
+// The active drivers are tracked in a bitmap and the value of the net is
+// resolved once per step after the drivers changed, then it's pushed to the
+// targets. Tri-state buffers stop being active while they're disabled.
+struct SimNet {
+    uint32_t id;
+    uint32_t index; // position in the nets of the simulation
+    uint8_t width;
+    uint32_t stateIndex; // the resolved value, use SimGetNetState to read it
+
+    bool dirty; // waiting to be resolved
+
+    struct {
+        SimPin **items;
+        size_t count;
+        size_t capacity;
+    } drivers;
+
+    // bit N is set when drivers.items[N] is driving the net
+    struct {
+        uint64_t *items;
+        size_t count;
+        size_t capacity;
+    } activeDrivers;
+
+    struct {
+        SimPin **items;
+        size_t count;
+        size_t capacity;
+    } targets;
 };
 
 SimChip *SimNandCreate(void);
 SimChip *SimLedCreate(void);
+SimChip *SimInputCreate(void);
+
+// Single bit primitives with their own evaluator, the importer uses them
+// instead of NANDs unless it's asked for NANDs only
+SimChip *SimAndCreate(void);
+SimChip *SimOrCreate(void);
+SimChip *SimXorCreate(void);
+SimChip *SimNotCreate(void);
+// inputs: a, b, select. The output is b when select is on
+SimChip *SimMuxCreate(void);
+// inputs: a, b, carry in. outputs: sum, carry out
+SimChip *SimFullAdderCreate(void);
+// inputs: data, clock. The output takes the data on the rising edge of the
+// clock. In four state mode an unknown clock that may be rising makes
+// unknown the bits where the data and the output differ
+SimChip *SimDffCreate(void);
+// inputs: data, enable. The output follows the data while the enable is on
+// and holds its value while it's off. In four state mode an unknown enable
+// makes unknown the bits where the data and the output differ
+SimChip *SimLatchCreate(void);
 
-void SimSetInputPinState(SimChip *chip, size_t index, uint8_t state);
-void SimSetOutputPinState(SimChip *chip, size_t index, uint8_t state);
+// Bus chips work on whole words, so a change on a bus is a single event no
+// matter how many bits changed. Every data pin has the given width, the
+// select pin of the mux and the carries of the adder are 1 bit wide.
+SimChip *SimBusInputCreate(uint8_t width);
+SimChip *SimBusLedCreate(uint8_t width);
+SimChip *SimBusAndCreate(uint8_t width);
+SimChip *SimBusOrCreate(uint8_t width);
+SimChip *SimBusXorCreate(uint8_t width);
+// inputs: a, b, carry in. outputs: sum, carry out
+SimChip *SimBusAddCreate(uint8_t width);
+// inputs: a, b, select. The output is b when select is on
+SimChip *SimBusMuxCreate(uint8_t width);
+// one bus input to "width" 1 bit outputs, output 0 is the least significant bit
+SimChip *SimBusSplitCreate(uint8_t width);
+// "width" 1 bit inputs to one bus output
+SimChip *SimBusJoinCreate(uint8_t width);
+// inputs: data, enable. Output 0 follows the data while enabled, output 1
+// is on while the buffer is driving. A disabled buffer outputs Z in four
+// state mode and 0 in two state mode
+SimChip *SimTristateCreate(uint8_t width);
+
+// the state is masked to the width of the pin
+void SimSetInputPinState(SimChip *chip, size_t index, uint64_t state);
+void SimSetOutputPinState(SimChip *chip, size_t index, uint64_t state);
 
 SimPin *SimGetInputPin(SimChip *chip, size_t index);
 SimPin *SimGetOutputPin(SimChip *chip, size_t index);
 
+uint64_t SimGetPinState(SimPin *pin);
+
+// Four state logic (0, 1, X and Z). Every pin gets a second bit-plane with
+// the bits that are unknown, an unknown bit is X when its value is 1 and Z
+// when it's 0. The chips read Z as X and compute both planes with bitwise
+// operations, so two state circuits get the same results. While the mode is
+// enabled new inputs start as X until they're set. The second plane is only
+// allocated while the mode is enabled, disabling it turns X into 1 and Z into 0.
+void SimSetFourState(bool enabled);
+bool SimGetFourState(void);
+// the unknown plane of the pin, always 0 in two state mode
+uint64_t SimGetPinUnknown(SimPin *pin);
+// returns '0', '1', 'X' or 'Z'
+char SimGetPinBit(SimPin *pin, size_t bit);
+void SimSetOutputPinPlanes(SimChip *chip, size_t index, uint64_t value, uint64_t unknown);
+
+// an input pin can only be connected to one output pin of the same width
 void SimAddPinConnection(SimPin *outPin, SimPin *inPin);
+// the input pin goes back to off
+void SimRemovePinConnection(SimPin *outPin, SimPin *inPin);
+
+// Nets let several outputs drive the same inputs. Every driver and target
+// must have the width of the net. In four state mode every bit is resolved
+// on its own: drivers that disagree give X and a net without active drivers
+// is Z. In two state mode the active drivers are ORed and a net without
+// active drivers is 0. An input pin can't be connected to a net and to an
+// output pin at the same time.
+SimNet *SimNetCreate(uint8_t width);
+void SimNetAddDriver(SimNet *net, SimPin *outPin);
+void SimNetAddTarget(SimNet *net, SimPin *inPin);
+void SimNetRemoveDriver(SimNet *net, SimPin *outPin);
+// the input pin goes back to off
+void SimNetRemoveTarget(SimNet *net, SimPin *inPin);
+// the targets go back to off, the pointer to the net becomes invalid
+void SimNetDestroy(SimNet *net);
+uint64_t SimGetNetState(SimNet *net);
+uint64_t SimGetNetUnknown(SimNet *net);
+
+// removes the chip and all its connections, the inputs it was driving go
+// back to off. The pointers to the chip and its pins become invalid.
+void SimDestroyChip(SimChip *chip);
+
+// Bulk building. Connections made between SimBuildBegin and SimBuildEnd are
+// only recorded, at the end every fan-out array is allocated once with its
+// exact size and the whole circuit is settled in a single pass.
+void SimBuildBegin(void);
+void SimBuildConnect(SimPin *outPin, SimPin *inPin);
+void SimBuildEnd(void);
+
+// Selects the engine used to propagate the changes, returns false if the
+// engine can't simulate the circuit. While the levelized engine is active
+// every new connection patches only the levels of the chips after it, the
+// levels are recomputed from scratch after many patches. If a connection
+// closes a loop the simulation goes back to the event driven engine.
+bool SimSetEngine(SimEngine engine);
+SimEngine SimGetEngine(void);
+
+// evaluates every chip waiting in the event queue, returns true if the
+// step produced new events
+bool SimStep(void);
+// steps until there are no more events, returns false if the circuit didn't
+// settle after SIM_MAX_SETTLE_STEPS (or one step per chip on bigger circuits)
+bool SimSettle(void);
+// Every edit (setting a pin, connecting, destroying a chip...) settles the
+// circuit before returning. When disabled the edits only schedule their
+// events and the circuit advances with SimStep or SimRun.
+void SimSetAutoSettle(bool enabled);
+bool SimGetAutoSettle(void);
+// Advances the circuit until it settles, "maxMicroseconds" pass or "maxEvents"
+// chips are evaluated (0 means no limit). The clock is checked every few
+// hundred events, so a big step can be left halfway and continued by the
+// next call. Returns true if the circuit is settled.
+bool SimRun(uint64_t maxMicroseconds, size_t maxEvents);
+// Cycle based simulation of synchronous circuits: every flip-flop has to be
+// clocked by the same input, which doesn't drive anything else, and the
+// logic can't have loops. A cycle is a whole clock period: the flip-flops
+// take their data at once and then the chips whose inputs changed are
+// evaluated once in topological order, without an event queue. The clock
+// input keeps its value and the glitches between the edges aren't simulated.
+// Settles the circuit first, every cycle counts as a step. Returns the number
+// of cycles run, fewer if a watch stopped them and 0 if the circuit isn't
+// synchronous or the demand driven mode is enabled.
+size_t SimRunCycles(size_t cycles);
+// number of steps completed since the simulation was created, a level counts
+// as a step in the levelized engine
+uint64_t SimGetStepCount(void);
+// number of chips evaluated by the steps and the cycles (a flip-flop taking
+// its data counts as one). SimRun never stops right after starting a step, so
+// the same edits made at the same event count always give the same simulation
+uint64_t SimGetEventCount(void);
+
+// Called by SimSetInputPinState and SimSetOutputPinPlanes (and the functions
+// built on them) before the change, except while building. Used to record
+// the stimulus of a session, see journal.h
+typedef void (*SimStimulusHook)(SimChip *chip, bool isInput, size_t index, uint64_t value, uint64_t unknown);
+void SimSetStimulusHook(SimStimulusHook hook);
+// Called by SimRunCycles before every cycle, once the circuit is settled. Used
+// to record the cycles of a session, see journal.h
+typedef void (*SimCycleHook)(void);
+void SimSetCycleHook(SimCycleHook hook);
+
+// Saves the state of every pin and the pending events in one buffer. Restoring
+// it is just a copy, so a snapshot taken right after building the circuit
+// works as a cheap "reset to power-on". A snapshot can only be restored while
+// the netlist is the same it was when the snapshot was taken.
+SimStateSnapshot *SimSnapshot(void);
+bool SimRestore(SimStateSnapshot *snapshot);
+void SimSnapshotFree(SimStateSnapshot *snapshot);
+
+// Reverse debugging: while enabled the simulation keeps a snapshot every
+// "interval" steps (0 only takes them when the log grows to a quarter of a
+// snapshot) and a log of every pin written after it. Going back restores the
+// closest snapshot and replays its log without evaluating any chip. The
+// oldest snapshots are dropped to keep the history under "maxBytes", at least
+// one is always kept. Editing the netlist, the engine or the logic mode
+// starts the history again from that point.
+void SimHistoryEnable(size_t maxBytes, size_t interval);
+void SimHistoryDisable(void);
+// oldest step that can be reached, the current one when disabled
+uint64_t SimHistoryGetOldestStep(void);
+// Leaves the circuit as it was right before the given step started (the edits
+// made before it included) and forgets the steps after it. Returns false if
+// the step is out of the history. The event count isn't rewound.
+bool SimHistoryGoTo(uint64_t step);
+bool SimHistoryStepBack(void);
+
+typedef enum {
+    // any bit of the mask changes
+    SIM_WATCH_CHANGE,
+    // the masked bits become equal to the value, an unknown bit never matches
+    SIM_WATCH_MATCH,
+} SimWatchKind;
+
+typedef struct {
+    uint32_t watch;
+    SimPin *pin;
+    uint64_t step; // SimGetStepCount when it triggered
+    uint64_t events; // SimGetEventCount when it triggered
+    uint64_t value; // the new state of the pin
+    uint64_t unknown;
+} SimWatchHit;
+
+// Watchpoints stop SimRun and SimSettle when a pin changes as asked, the
+// levelized engine stops right after the chip that changed it and the event
+// driven one at the end of the step. Every hit is recorded until
+// SimWatchClearHits, the edits made from outside only record them. Calling
+// SimRun or SimSettle again continues. Only the pins with a watch are
+// checked, the rest pay nothing. For example SIM_WATCH_MATCH with mask and
+// value 1 << 3 stops when the bit 3 rises, with mask ~0 and value 0xDEAD when
+// the bus becomes 0xDEAD. Returns the id of the watch.
+uint32_t SimWatchAdd(SimPin *pin, SimWatchKind kind, uint64_t mask, uint64_t value);
+// the watches of a pin are removed with it
+void SimWatchRemove(uint32_t id);
+// true if a watch stopped the last SimRun or SimSettle
+bool SimWatchStopped(void);
+size_t SimWatchGetHitCount(void);
+const SimWatchHit *SimWatchGetHit(size_t index);
+void SimWatchClearHits(void);
+
+// Toggle coverage: while enabled every pin remembers if it ever rose and if
+// it ever fell, in two bitmaps indexed by SimPin.stateIndex that are only
+// touched when a pin is written. A bus pin rises when any of its bits goes
+// from 0 to 1, the transitions from or to X and Z don't count. Enabling it
+// again starts from scratch. See coverage.h to save, merge and report it.
+#define SIM_TOGGLE_RISE 1
+#define SIM_TOGGLE_FALL 2
+void SimCoverageEnable(void);
+void SimCoverageDisable(void);
+bool SimCoverageIsEnabled(void);
+// SIM_TOGGLE_RISE and SIM_TOGGLE_FALL flags, 0 while disabled
+uint8_t SimCoverageGetPin(SimPin *pin);
+// adds the flags to the pin, used to merge the coverage of other runs
+void SimCoverageMarkPin(SimPin *pin, uint8_t toggles);
+
+// Switching activity: while enabled every output pin counts the bits that
+// changed when it was written (a change from or to X or Z counts too), in a
+// counter per slot that's only touched when an output is written. Enabling
+// it again starts from zero. See activity.h for the report.
+void SimActivityEnable(void);
+void SimActivityDisable(void);
+bool SimActivityIsEnabled(void);
+// bit transitions of an output pin, 0 while disabled
+uint64_t SimActivityGetPin(SimPin *pin);
+
+// Demand driven mode: only the chips in the cone of influence of the observed
+// pins (the inputs of the LEDs, the probes and the pins with a watch) are
+// evaluated. The chips out of it still get their inputs written, but they're
+// only marked as stale and evaluated once they join the cone, so their
+// outputs can be outdated and their flip-flops miss the clock edges. The cone
+// is computed when the mode is enabled and again at the start of the next
+// step after the netlist or the observed pins change. Disabling it brings
+// the stale chips up to date.
+void SimDemandEnable(void);
+void SimDemandDisable(void);
+bool SimDemandIsEnabled(void);
+// chips in the cone, computed again if it's outdated
+size_t SimDemandGetConeSize(void);
+// the probes of a pin are removed with it
+void SimProbeAdd(SimPin *pin);
+void SimProbeRemove(SimPin *pin);
+
+size_t SimGetChipCount(void);
+SimChip *SimGetChip(size_t index);
+// the input pins fed by an output pin, directly or through its net
+size_t SimGetFanOutCount(SimPin *out);
+SimPin *SimGetFanOutTarget(SimPin *out, size_t index);
+// Fills "order" (room for SimGetChipCount chips) with the chips sorted
+// topologically and returns how many were sorted. The connections to the
+// passive pins don't count, so the loops through flip-flops are cut. The
+// chips that are part of another loop (or driven by one) are left out.
+size_t SimSortTopologically(SimChip **order);
+// number of slots used to store the pin states, SimPin.stateIndex is always lower
+size_t SimGetStateSlotCount(void);
+// copies SimGetStateSlotCount slots of every plane, "unknown" can be NULL
+// and is filled with zeros in two state mode. The slot of a pulled pin gets
+// the state the pin reads, so the copy is indexed by SimPin.stateIndex
+void SimCopyPinStates(uint64_t *states, uint64_t *unknown);
+const char *SimGetChipTypeName(ChipType type);
 
 void SimPrintChip(SimChip *chip);
 
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "timing.h"
+#include "CCFuncs.h"
+
+typedef struct {
+    SimChip *chip;
+    uint32_t length;
+} TimingEndpoint;
+
+// the flip-flops start new paths, their inputs don't wait for anything
+static bool IsSequential(SimChip *chip) {
+    return chip->type == CHIP_DFF;
+}
+
+static uint32_t GetChipDelay(const uint32_t *delays, SimChip *chip) {
+    if(delays != NULL) return delays[chip->type];
+    return chip->type == CHIP_INPUT || chip->type == CHIP_LED ? 0 : 1;
+}
+
+// the longest arrival at the inputs of the chip and the chip it comes from,
+// TIMING_IN_LOOP if a driver is in a loop
+static uint32_t GetInputArrival(uint32_t *arrivals, SimChip *chip, SimChip **pred) {
+    uint32_t arrival = 0;
+    *pred = NULL;
+
+    for(size_t i = 0; i < chip->inputs.count; i++) {
+        SimPin *pin = &chip->inputs.items[i];
+        size_t driverCount = pin->net != NULL ? pin->net->drivers.count : pin->source != NULL;
+
+        for(size_t j = 0; j < driverCount; j++) {
+            SimChip *driver = pin->net != NULL ? pin->net->drivers.items[j]->parentChip : pin->source->parentChip;
+            uint32_t driverArrival = arrivals[driver->index];
+
+            if(driverArrival == TIMING_IN_LOOP) return TIMING_IN_LOOP;
+
+            if(*pred == NULL || driverArrival > arrival) {
+                arrival = driverArrival;
+                *pred = driver;
+            }
+        }
+    }
+
+    return arrival;
+}
+
+static bool DrivesAnything(SimChip *chip) {
+    for(size_t i = 0; i < chip->outputs.count; i++) {
+        if(SimGetFanOutCount(&chip->outputs.items[i]) > 0) return true;
+    }
+
+    return false;
+}
+
+// Kahn's algorithm where the connections to the flip-flops don't count,
+// returns how many chips were sorted
+static size_t SortCombinational(SimChip **order) {
+    size_t count = SimGetChipCount();
+    uint32_t *pending = calloc(count > 0 ? count : 1, sizeof(uint32_t));
+    assert(pending != NULL && "No enough ram");
+
+    for(size_t i = 0; i < count; i++) {
+        SimChip *chip = SimGetChip(i);
+
+        for(size_t j = 0; j < chip->outputs.count; j++) {
+            SimPin *out = &chip->outputs.items[j];
+
+            for(size_t k = 0; k < SimGetFanOutCount(out); k++) {
+                SimChip *target = SimGetFanOutTarget(out, k)->parentChip;
+                if(!IsSequential(target)) pending[target->index]++;
+            }
+        }
+    }
+
+    size_t head = 0, tail = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(pending[i] == 0) order[tail++] = SimGetChip(i);
+    }
+
+    while(head < tail) {
+        SimChip *chip = order[head++];
+
+        for(size_t j = 0; j < chip->outputs.count; j++) {
+            SimPin *out = &chip->outputs.items[j];
+
+            for(size_t k = 0; k < SimGetFanOutCount(out); k++) {
+                SimChip *target = SimGetFanOutTarget(out, k)->parentChip;
+                if(!IsSequential(target) && --pending[target->index] == 0) order[tail++] = target;
+            }
+        }
+    }
+
+    free(pending);
+    return tail;
+}
+
+static int CompareEndpoints(const void *a, const void *b) {
+    const TimingEndpoint *endpointA = a, *endpointB = b;
+
+    if(endpointA->length != endpointB->length) return endpointA->length < endpointB->length ? 1 : -1;
+    return (int)endpointA->chip->index - (int)endpointB->chip->index;
+}
+
+static void AddPath(TimingReport *report, SimChip **preds, TimingEndpoint endpoint) {
+    TimingPath path = {endpoint.chip, endpoint.length, {0}};
+
+    // walked backwards and reversed
+    da_append(&path.chips, endpoint.chip);
+
+    for(SimChip *chip = preds[endpoint.chip->index]; chip != NULL; chip = preds[chip->index]) {
+        da_append(&path.chips, chip);
+        if(IsSequential(chip)) break;
+    }
+
+    for(size_t i = 0; i < path.chips.count/2; i++) {
+        SimChip *chip = path.chips.items[i];
+        path.chips.items[i] = path.chips.items[path.chips.count - 1 - i];
+        path.chips.items[path.chips.count - 1 - i] = chip;
+    }
+
+    da_append(&report->paths, path);
+}
+
+void TimingAnalyze(const uint32_t *delays, size_t maxPaths, TimingReport *report) {
+    size_t count = SimGetChipCount();
+    *report = (TimingReport){0};
+
+    report->chipCount = count;
+    report->arrivals = malloc((count > 0 ? count : 1)*sizeof(uint32_t));
+    SimChip **preds = malloc((count > 0 ? count : 1)*sizeof(SimChip*));
+    SimChip **order = malloc((count > 0 ? count : 1)*sizeof(SimChip*));
+    assert(report->arrivals != NULL && preds != NULL && order != NULL && "No enough ram");
+
+    for(size_t i = 0; i < count; i++) {
+        report->arrivals[i] = TIMING_IN_LOOP;
+        preds[i] = NULL;
+    }
+
+    size_t sorted = SortCombinational(order);
+    report->loopChips = count - sorted;
+
+    for(size_t i = 0; i < sorted; i++) {
+        SimChip *chip = order[i];
+        uint32_t delay = GetChipDelay(delays, chip);
+
+        if(IsSequential(chip)) {
+            report->arrivals[chip->index] = delay;
+        } else {
+            report->arrivals[chip->index] = GetInputArrival(report->arrivals, chip, &preds[chip->index]) + delay;
+        }
+    }
+
+    struct {
+        TimingEndpoint *items;
+        size_t count;
+        size_t capacity;
+    } endpoints = {0};
+
+    for(size_t i = 0; i < sorted; i++) {
+        SimChip *chip = order[i];
+        uint32_t length;
+
+        // every driver of a flip-flop has its arrival now
+        if(IsSequential(chip)) {
+            length = GetInputArrival(report->arrivals, chip, &preds[chip->index]);
+            if(length == TIMING_IN_LOOP) continue;
+        } else if(!DrivesAnything(chip)) {
+            length = report->arrivals[chip->index];
+        } else {
+            continue;
+        }
+
+        if(length > report->maxLength) report->maxLength = length;
+        da_append(&endpoints, ((TimingEndpoint){chip, length}));
+    }
+
+    if(endpoints.count > 0) {
+        qsort(endpoints.items, endpoints.count, sizeof(TimingEndpoint), CompareEndpoints);
+    }
+
+    for(size_t i = 0; i < endpoints.count && i < maxPaths; i++) {
+        AddPath(report, preds, endpoints.items[i]);
+    }
+
+    da_free(&endpoints);
+    free(order);
+    free(preds);
+}
+
+uint32_t TimingGetPinArrival(TimingReport *report, SimPin *pin) {
+    assert(pin->parentChip->index < report->chipCount);
+    return report->arrivals[pin->parentChip->index];
+}
+
+static void PrintChip(SimChip *chip) {
+    printf("%s (#%u)", SimGetChipTypeName(chip->type), chip->id);
+}
+
+void TimingPrintReport(TimingReport *report) {
+    printf("Longest path: %u", report->maxLength);
+    if(report->loopChips > 0) printf(" (%lu chips in combinational loops aren't timed)", report->loopChips);
+    printf("\n");
+
+    if(report->paths.count == 0) return;
+
+    printf("Critical paths:\n");
+    for(size_t i = 0; i < report->paths.count; i++) {
+        TimingPath *path = &report->paths.items[i];
+
+        printf("  %u: ", path->length);
+
+        for(size_t j = 0; j < path->chips.count; j++) {
+            if(j > 0) printf(" -> ");
+            PrintChip(path->chips.items[j]);
+        }
+
+        printf("\n");
+    }
+}
+
+void TimingReportFree(TimingReport *report) {
+    for(size_t i = 0; i < report->paths.count; i++) {
+        da_free(&report->paths.items[i].chips);
+    }
+
+    da_free(&report->paths);
+    free(report->arrivals);
+    *report = (TimingReport){0};
+}
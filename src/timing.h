@@ -0,0 +1,56 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "simulation.h"
+
+// Static timing of the combinational logic: the arrival time of every chip
+// is the longest path from a primary input or a flip-flop to its outputs,
+// computed in one pass over the chips in topological order. The paths end at
+// the chips that don't drive anything (the LEDs) and at the inputs of the
+// flip-flops, which also start new paths.
+
+// one delay per ChipType, CHIP_INPUT is the last type
+#define TIMING_CHIP_TYPE_COUNT (CHIP_INPUT + 1)
+// the arrival of the chips in a combinational loop (or driven by one)
+#define TIMING_IN_LOOP UINT32_MAX
+
+typedef struct {
+    SimChip *endpoint;
+    uint32_t length; // arrival at the inputs of the endpoint
+
+    // from the start of the path to the endpoint
+    struct {
+        SimChip **items;
+        size_t count;
+        size_t capacity;
+    } chips;
+} TimingPath;
+
+typedef struct {
+    // by SimChip.index
+    uint32_t *arrivals;
+    size_t chipCount;
+    size_t loopChips;
+
+    // the longest path. With the default delays and without flip-flops or
+    // loops a settle takes at most this many steps of the event driven engine
+    uint32_t maxLength;
+
+    // the worst path of each endpoint, the longest first
+    struct {
+        TimingPath *items;
+        size_t count;
+        size_t capacity;
+    } paths;
+} TimingReport;
+
+// "delays" has TIMING_CHIP_TYPE_COUNT entries, NULL gives a delay of 1 to
+// every evaluated chip (so the lengths are gate levels) and 0 to the inputs
+// and the LEDs. Keeps the "maxPaths" worst endpoints.
+void TimingAnalyze(const uint32_t *delays, size_t maxPaths, TimingReport *report);
+// arrival at an output pin, TIMING_IN_LOOP for the chips in a loop
+uint32_t TimingGetPinArrival(TimingReport *report, SimPin *pin);
+void TimingPrintReport(TimingReport *report);
+void TimingReportFree(TimingReport *report);
+
+#endif // TIMING_H
@@ -4,8 +4,30 @@
 typedef enum {
     CHIP_NAND,
 
+    // single bit primitives, they're faster and smaller than the same
+    // logic built with NANDs
+    CHIP_AND,
+    CHIP_OR,
+    CHIP_XOR,
+    CHIP_NOT,
+    CHIP_MUX,
+    CHIP_FULL_ADDER,
+    CHIP_DFF,
+    CHIP_LATCH,
+
+    // bus chips, their pins carry up to 64 bits
+    CHIP_BUS_AND,
+    CHIP_BUS_OR,
+    CHIP_BUS_XOR,
+    CHIP_BUS_ADD,
+    CHIP_BUS_MUX,
+    CHIP_BUS_SPLIT,
+    CHIP_BUS_JOIN,
+    CHIP_TRISTATE,
+
     // not really chips, but they work under the same environment
     CHIP_LED,
+    CHIP_INPUT,
 } ChipType;
 
 #endif // TYPES_H
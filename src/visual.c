@@ -1,5 +1,5 @@
-#include "raymath.h"
 #include "visual.h"
+#include "raymath.h"
 #include "CCFuncs.h"
 
 #define VISUAL_PIN_RADIUS 10
@@ -158,7 +158,7 @@ void VisualUpdate(void) {
         VisualChip *chip = &state.chips.items[i];
         switch(chip->type) {
             case CHIP_NAND: UpdateNand(chip); break;
-            case CHIP_LED: assert(false && "TODO");
+            default: assert(false && "TODO");
         }
     }
 